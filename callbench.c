@@ -6,6 +6,9 @@
  * vDSO counterpart, so we can ensure minimal CPU time spent in the kernel and
  * leave just the time taken to perform the context switch.
  *
+ * This file is only the command-line interface; the benchmarks live in
+ * libcallbench.c.
+ *
  * Licensed under the MIT License (MIT)
  *
  * Copyright (c) 2018-2020 Danny Lin <danny@kdrag0n.dev>
@@ -29,196 +32,191 @@
  * SOFTWARE.
  */
 
-#include <sys/syscall.h>
-#include <sys/time.h>
-#include <sys/mman.h>
-#include <time.h>
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 
-#define TEST_READ_PATH "/dev/zero"
-#define TEST_READ_LEN 65536
-
-#define NS_PER_SEC 1000000000
-#define MS_PER_USEC 1000
-
-#if defined(__linux__)
-#define CLOCK_GETTIME_SYSCALL_NR __NR_clock_gettime
-#elif defined(__APPLE__)
-// macOS does not allow direct syscalls that bypass libSystem.dylib
-#define NO_DIRECT_SYSCALL
-#elif defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
-#define CLOCK_GETTIME_SYSCALL_NR SYS_clock_gettime
-#elif defined(__NetBSD__)
-#define CLOCK_GETTIME_SYSCALL_NR SYS___clock_gettime50
-#else
-#error Unsupported platform: missing clock_gettime syscall number!
-#endif
-
-typedef _Bool bool;
-typedef void (*bench_impl)(void);
-
-static char test_read_buf[TEST_READ_LEN];
-
-static long ts_to_ns(struct timespec ts) {
-    return ts.tv_nsec + (ts.tv_sec * NS_PER_SEC);
-}
-
-#ifndef NO_DIRECT_SYSCALL
-static void time_syscall_mb(void) {
-    struct timespec ts;
-    syscall(CLOCK_GETTIME_SYSCALL_NR, CLOCK_MONOTONIC, &ts);
-}
-#endif
-
-static void time_libc_mb(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-}
-
-static void getpid_syscall_mb(void) {
-    syscall(__NR_getpid);
-}
-
-static void mmap_mb(void) {
-    int fd = open(TEST_READ_PATH, O_RDONLY);
-    int len = TEST_READ_LEN;
-
-    void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
-    memcpy(test_read_buf, data, len);
-
-    munmap(data, len);
-    close(fd);
-}
-
-static void file_mb(void) {
-    int fd = open(TEST_READ_PATH, O_RDONLY);
-    long len = TEST_READ_LEN;
-
-    read(fd, test_read_buf, len);
-
-    close(fd);
-}
-
-static long run_bench_ns(bench_impl inner_call, int calls, int loops, int rounds) {
-    long best_ns1 = LONG_MAX;
-
-    for (int round = 0; round < rounds; round++) {
-        long best_ns2 = LONG_MAX;
-
-        for (int loop = 0; loop < loops; loop++) {
-            struct timespec before;
-            clock_gettime(CLOCK_MONOTONIC, &before);
-
-            for (int call = 0; call < calls; call++) {
-                inner_call();
-            }
-
-            struct timespec after;
-            clock_gettime(CLOCK_MONOTONIC, &after);
-
-            long elapsed_ns = ts_to_ns(after) - ts_to_ns(before);
-            if (elapsed_ns < best_ns2) {
-                best_ns2 = elapsed_ns;
-            }
-        }
-
-        best_ns2 /= calls; // per call in the loop
-
-        if (best_ns2 < best_ns1) {
-            best_ns1 = best_ns2;
-        }
-
-        putchar('.');
-        fflush(stdout);
-        usleep(125 * MS_PER_USEC);
-    }
-
-    return best_ns1;
-}
-
-static int default_arg(int arg, int def) {
-    return arg == -1 ? def : arg;
-}
-
-static void bench_time(int calls, int loops, int rounds) {
-    calls = default_arg(calls, 100000);
-    loops = default_arg(loops, 32);
-    rounds = default_arg(rounds, 5);
-
-    printf("clock_gettime: ");
-    fflush(stdout);
-
-#ifndef NO_DIRECT_SYSCALL
-    long best_ns_syscall = run_bench_ns(time_syscall_mb, calls, loops, rounds);
-    long best_ns_getpid = run_bench_ns(getpid_syscall_mb, calls, loops, rounds);
-#endif
-    long best_ns_libc = run_bench_ns(time_libc_mb, calls, loops, rounds);
-
-    putchar('\n');
-
-#ifdef NO_DIRECT_SYSCALL
-    printf("    syscall:\t<unsupported>\n");
-#else
-    printf("    syscall:\t%ld ns\n", best_ns_syscall);
-    printf("    getpid:\t%ld ns\n", best_ns_getpid);
-#endif
-    printf("    libc:\t%ld ns\n", best_ns_libc);
-}
-
-static void bench_file(int calls, int loops, int rounds) {
-    calls = default_arg(calls, 100);
-    loops = default_arg(loops, 128);
-    rounds = default_arg(rounds, 5);
-
-    printf("read file: ");
-    fflush(stdout);
-
-    long best_ns_mmap = run_bench_ns(mmap_mb, calls, loops, rounds);
-    long best_ns_read = run_bench_ns(file_mb, calls, loops, rounds);
-
-    printf("\n    mmap:\t%ld ns\n", best_ns_mmap);
-    printf("    read:\t%ld ns\n", best_ns_read);
-}
+#include "libcallbench.h"
+#include "callbench.h"
+
+enum {
+    OPT_PER_CALL = 256,
+    OPT_FIFO,
+    OPT_MLOCK,
+    OPT_WARMUP,
+    OPT_FORMAT,
+    OPT_LIST,
+    OPT_PATH,
+    OPT_SIZE,
+    OPT_PERF,
+    OPT_BATCH,
+    OPT_ADAPTIVE,
+    OPT_LOOP_MS,
+    OPT_BUDGET,
+    OPT_SAVE_BASELINE,
+    OPT_COMPARE,
+    OPT_THRESHOLD,
+    OPT_INLINE,
+    OPT_UNROLL,
+    OPT_SECCOMP_LEN,
+    OPT_DURATION,
+    OPT_INTERVAL,
+    OPT_STRESS,
+    OPT_STORAGE,
+    OPT_STORAGE_SIZE,
+    OPT_EXEC,
+    OPT_PREFAULT,
+    OPT_NUMA,
+    OPT_SPEC_CTRL,
+    OPT_TRACE,
+    OPT_TRACE_RING,
+};
 
-static char *short_options = "hm:c:l:r:";
+static char *short_options = "hm:c:l:r:dt:T:C:";
 static struct option long_options[] = {
     {"help", no_argument, 0, 'h'},
     {"mode", required_argument, 0, 'm'},
     {"calls", required_argument, 0, 'c'},
     {"loops", required_argument, 0, 'l'},
     {"rounds", required_argument, 0, 'r'},
+    {"dist", no_argument, 0, 'd'},
+    {"per-call", no_argument, 0, OPT_PER_CALL},
+    {"timer", required_argument, 0, 't'},
+    {"threads", required_argument, 0, 'T'},
+    {"cpu", required_argument, 0, 'C'},
+    {"fifo", optional_argument, 0, OPT_FIFO},
+    {"mlock", no_argument, 0, OPT_MLOCK},
+    {"warmup", required_argument, 0, OPT_WARMUP},
+    {"format", required_argument, 0, OPT_FORMAT},
+    {"list", no_argument, 0, OPT_LIST},
+    {"path", required_argument, 0, OPT_PATH},
+    {"size", required_argument, 0, OPT_SIZE},
+    {"perf", no_argument, 0, OPT_PERF},
+    {"batch", required_argument, 0, OPT_BATCH},
+    {"adaptive", optional_argument, 0, OPT_ADAPTIVE},
+    {"loop-ms", required_argument, 0, OPT_LOOP_MS},
+    {"budget", required_argument, 0, OPT_BUDGET},
+    {"save-baseline", required_argument, 0, OPT_SAVE_BASELINE},
+    {"compare", required_argument, 0, OPT_COMPARE},
+    {"threshold", required_argument, 0, OPT_THRESHOLD},
+    {"inline", no_argument, 0, OPT_INLINE},
+    {"unroll", required_argument, 0, OPT_UNROLL},
+    {"seccomp-len", required_argument, 0, OPT_SECCOMP_LEN},
+    {"duration", required_argument, 0, OPT_DURATION},
+    {"interval", required_argument, 0, OPT_INTERVAL},
+    {"stress", required_argument, 0, OPT_STRESS},
+    {"storage", required_argument, 0, OPT_STORAGE},
+    {"storage-size", required_argument, 0, OPT_STORAGE_SIZE},
+    {"exec", required_argument, 0, OPT_EXEC},
+    {"prefault", required_argument, 0, OPT_PREFAULT},
+    {"numa", no_argument, 0, OPT_NUMA},
+    {"spec-ctrl", no_argument, 0, OPT_SPEC_CTRL},
+    {"trace", required_argument, 0, OPT_TRACE},
+    {"trace-ring", required_argument, 0, OPT_TRACE_RING},
     {}
 };
 
 static void print_help(char *prog_name) {
     printf("Usage: %s [options]\n"
         "\n"
-        "This program benchmarks some simple kernel syscalls:\n"
-        "  Time: clock_gettime(CLOCK_MONOTONIC) with direct syscalls and libc wrapper calls\n"
-        "  File: reads 64 KiB of data from /dev/zero with mmap(2) and read(2)\n"
+        "This program benchmarks some simple kernel syscalls (see --list for all of them):\n"
+        "  Time: clock_gettime with every clock ID, clock_getres, gettimeofday, time and getcpu, each with\n"
+        "        direct syscalls and libc wrapper calls; libc calls no faster than the syscall are flagged\n"
+        "  Entry: getpid and an invalid syscall with inline syscall/svc instructions, int 0x80 on x86_64,\n"
+        "        and getpid on a thread with a seccomp filter (see --seccomp-len)\n"
+        "  File: reads 64 KiB of data from /dev/zero (see --path and --size) with mmap(2) and read(2), with variants\n"
+        "        that open the file in advance to separate lookup, fault and copy costs, and moves the\n"
+        "        same data with sendfile, splice, vmsplice and copy_file_range\n"
+        "  Mem:  anonymous mmap, page faults with and without MAP_POPULATE, THP faults, MADV_DONTNEED\n"
+        "        re-faults and mprotect on --size bytes, with the cost per page\n"
+        "  BW:   libc memcpy and memset against SSE2, AVX2, AVX-512 and NEON copies and non-temporal\n"
+        "        stores, at sizes for each cache level and DRAM unless --size is given\n"
+        "  Storage: cold buffered reads, readahead and MADV_WILLNEED, RWF_NOWAIT misses and O_DIRECT reads\n"
+        "        at each --batch queue depth on a --storage file, at random --size aligned offsets\n"
+        "  Net:  socketpair, loopback UDP with and without sendmmsg/recvmmsg batching, TCP round trips,\n"
+        "        TCP streams with and without MSG_ZEROCOPY and epoll_wait with a zero timeout\n"
+        "  IPC:  pipe, eventfd, futex and sched_yield round trips with a peer thread on the same CPU,\n"
+        "        another CPU or another NUMA node, to measure wakeup and context switch cost\n"
+        "  Proc: fork, vfork, clone3 with CLONE_VM, pthread_create, posix_spawn and fork+execve, with\n"
+        "        optionally a large RSS to copy page tables for (see --prefault)\n"
+        "  Sync: pthread mutex, rwlock and spinlock, a futex mutex, futex_wake, futex_waitv and atomics on\n"
+        "        shared and padded cache lines, uncontended or contended across --threads with handoff latency\n"
         "\n"
         "libc time calls may be faster than direct syscalls on some platforms due to\n"
         "special fast paths without context switching, e.g. Linux's vDSO.\n"
         "\n"
+        "Results have the loop, call dispatch and timer overhead (measured with an empty\n"
+        "call before each group) subtracted, with the raw figures shown alongside.\n"
+        "\n"
         "Options:\n"
         "  -h, --help\tshow usage help and exit\n"
-        "  -m, --mode\ttests to run: time, file, or all (default: all)\n"
-        "  -c, --calls\tnumber of syscalls to make per loop (default: 100000 for time, 100 for file)\n"
-        "  -l, --loops\tnumber of loops to run per round (default: 32 for time, 128 for file)\n"
-        "  -r, --rounds\tnumber of benchmark rounds to run (default: 5)\n",
+        "  -m, --mode\tcomma-separated groups, benchmarks or group.benchmark globs to run, or all (default: all)\n"
+        "      --list\tlist available groups and benchmarks with their defaults and exit\n"
+        "  -c, --calls\tnumber of syscalls to make per loop (default: per benchmark)\n"
+        "  -l, --loops\tnumber of loops to run per round (default: per benchmark)\n"
+        "  -r, --rounds\tnumber of benchmark rounds to run (default: per benchmark)\n"
+        "  -d, --dist\treport latency percentiles and a histogram of every loop\n"
+        "      --per-call\ttime every call individually for --dist (uses 8 bytes per call)\n"
+        "  -t, --timer\ttiming source: clock (CLOCK_MONOTONIC) or cycles (rdtsc/cntvct_el0) (default: clock)\n"
+        "  -T, --threads\trun on 1, 2, 4, ... up to N pinned threads concurrently and report throughput scaling\n"
+        "  -C, --cpu\tpin to the first CPU in a list such as 2 or 0-3,8; threads use the rest of the list\n"
+        "      --fifo\trun with SCHED_FIFO at the given priority (default: 1)\n"
+        "      --mlock\tlock all current memory with mlockall(2)\n"
+        "      --warmup\tms to spin before each round to reach a steady clock speed (default: 125)\n"
+        "      --format\toutput format: text, json (one object per line) or csv (default: text)\n"
+        "      --path\tfile for the file benchmarks to read (default: " TEST_READ_PATH ")\n"
+        "      --size\ttransfer sizes for the file benchmarks, e.g. 4K,1M or 4K-16M for powers of two (default: 64K);\n"
+        "\t\tlarger sizes run proportionally fewer calls per loop unless --calls is given\n"
+        "      --perf\tcount cycles, instructions, branch, cache and TLB misses per call with perf_event_open(2)\n"
+        "      --batch\tcomma-separated operations per submission for batched benchmarks (default: 1,8,32)\n"
+        "      --adaptive\tsize calls so each loop lasts --loop-ms, then run rounds until the 95%% confidence\n"
+        "\t\tinterval on the median is within the given percentage (default: 1) or --budget expires;\n"
+        "\t\treports the mean, stddev, CI and outliers of every loop (--threads only sizes calls)\n"
+        "      --loop-ms\ttarget loop duration for --adaptive (default: 10)\n"
+        "      --budget\tseconds --adaptive may spend on each benchmark (default: 10)\n"
+        "      --save-baseline\twrite every loop sample of each benchmark to a file for --compare\n"
+        "      --compare\ttest each benchmark against a saved baseline with a Mann-Whitney U test and exit\n"
+        "\t\twith status 2 if any is significantly slower by more than --threshold\n"
+        "      --threshold\tslowdown in percent of the median that --compare treats as a regression (default: 5)\n"
+        "      --inline\talso time benchmarks with a loop that inlines the call instead of dispatching it\n"
+        "\t\tthrough a function pointer, and report the difference; only benchmarks cheap enough for\n"
+        "\t\tdispatch to matter have such a loop (the time and entry groups, pread, memcpy, epoll_wait\n"
+        "\t\tand the uncontended sync locks and atomics)\n"
+        "      --unroll\tunroll the --inline loops by 1, 4 or 8 (implies --inline, default: 1)\n"
+        "      --seccomp-len\tcomparisons in the seccomp benchmarks' BPF filters (default: 64)\n"
+        "      --duration\tsoak: run each benchmark continuously for this many seconds and report its\n"
+        "\t\tthroughput and latency percentiles every --interval as a time series\n"
+        "      --interval\tms between --duration reports (default: 100)\n"
+        "      --stress\tbackground load while benchmarking: comma-separated cpu, mem, syscall or fault,\n"
+        "\t\teach with an optional thread count such as mem:2\n"
+        "      --storage\tfile on the device to test for the storage benchmarks, created and removed\n"
+        "\t\tafterwards if it doesn't exist (default: none, so they're unsupported)\n"
+        "      --storage-size\tsize of a --storage file to create (default: 256M)\n"
+        "      --exec\tprogram for the exec benchmarks to run with no arguments, ideally a trivial static\n"
+        "\t\tbinary (default: this program, told to exit immediately)\n"
+        "      --prefault\twrite to this much anonymous memory before benchmarking, e.g. 1G, to see how\n"
+        "\t\tfork scales with RSS\n"
+        "      --numa\trun each benchmark on every NUMA node with its memory bound to every node in turn,\n"
+        "\t\tand print a matrix of latency and bandwidth by CPU node and memory node\n"
+        "      --spec-ctrl\talso rerun each benchmark on a thread with each prctl(2) speculation control\n"
+        "\t\tturned on (SSBD, STIBP with IBPB on switch and L1D flush) and report what it adds\n"
+        "      --trace\twrite a trace_marker event for every loop (or call with --per-call) slower than this\n"
+        "\t\tmany ns per call before overhead is subtracted, to line outliers up with scheduler and IRQ\n"
+        "\t\tevents in ftrace or perf\n"
+        "      --trace-ring\tsave the raw timestamps of the last 1M loops to this file for offline analysis\n"
+        "\t\t(see README.md for the format)\n",
         prog_name);
 
     exit(1);
 }
 
-static void parse_args(int argc, char **argv, bool *do_time, bool *do_file, int *calls, int *loops, int *rounds) {
+static void parse_args(int argc, char **argv, struct options *opts) {
+    bool mode_set = 0;
+
     while (1) {
         int c = getopt_long(argc, argv, short_options, long_options, NULL);
         if (c == -1)
@@ -230,53 +228,340 @@ static void parse_args(int argc, char **argv, bool *do_time, bool *do_file, int
             print_help(argv[0]);
             break;
         case 'm':
-            if (!strcmp(optarg, "time")) {
-                *do_time = 1;
-                *do_file = 0;
-            } else if (!strcmp(optarg, "file")) {
-                *do_time = 0;
-                *do_file = 1;
-            } else if (!strcmp(optarg, "all")) {
-                *do_time = 1;
-                *do_file = 1;
-            } else {
+            if (cb_select_benchmarks(optarg) != 0) {
                 fprintf(stderr, "%s: invalid mode -- '%s'\n", argv[0], optarg);
                 print_help(argv[0]);
             }
+            mode_set = 1;
+            break;
+        case OPT_LIST:
+            cb_list_benchmarks();
+            exit(0);
             break;
         case 'c':
-            *calls = atoi(optarg);
+            opts->calls = atoi(optarg);
             break;
         case 'l':
-            *loops = atoi(optarg);
+            opts->loops = atoi(optarg);
             break;
         case 'r':
-            *rounds = atoi(optarg);
+            opts->rounds = atoi(optarg);
+            break;
+        case 'd':
+            opts->dist = 1;
+            break;
+        case 't':
+            if (!strcmp(optarg, "clock")) {
+                opts->timer = TIMER_CLOCK;
+#ifdef HAVE_CYCLE_TIMER
+            } else if (!strcmp(optarg, "cycles")) {
+                opts->timer = TIMER_CYCLES;
+#endif
+            } else {
+                fprintf(stderr, "%s: invalid timer -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case 'T':
+            opts->threads = atoi(optarg);
+            if (opts->threads < 1 || opts->threads > MAX_THREADS) {
+                fprintf(stderr, "%s: invalid thread count -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case 'C':
+            cb_nr_cpu_list = cb_parse_cpu_list(optarg, cb_cpu_list, MAX_THREADS);
+            if (cb_nr_cpu_list <= 0) {
+                fprintf(stderr, "%s: invalid CPU list -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_FIFO:
+            opts->fifo_prio = optarg ? atoi(optarg) : 1;
+            if (opts->fifo_prio < 1) {
+                fprintf(stderr, "%s: invalid priority -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_MLOCK:
+            opts->mlock = 1;
+            break;
+        case OPT_WARMUP:
+            cb_warmup_ms = atoi(optarg);
+            break;
+        case OPT_FORMAT:
+            if (!strcmp(optarg, "text")) {
+                cb_output_format = FORMAT_TEXT;
+            } else if (!strcmp(optarg, "json")) {
+                cb_output_format = FORMAT_JSON;
+            } else if (!strcmp(optarg, "csv")) {
+                cb_output_format = FORMAT_CSV;
+            } else {
+                fprintf(stderr, "%s: invalid format -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_PATH:
+            cb_test_read_path = optarg;
+            break;
+        case OPT_SIZE:
+            cb_nr_xfer_sizes = cb_parse_size_list(optarg, cb_xfer_sizes, MAX_XFER_SIZES);
+            cb_xfer_sizes_set = 1;
+            if (cb_nr_xfer_sizes <= 0) {
+                fprintf(stderr, "%s: invalid size list -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_PERF:
+            opts->perf = 1;
+            break;
+        case OPT_BATCH: {
+            long sizes[MAX_BATCH_SIZES];
+            cb_nr_batch_sizes = cb_parse_size_list(optarg, sizes, MAX_BATCH_SIZES);
+            for (int i = 0; i < cb_nr_batch_sizes; i++) {
+                if (sizes[i] > MAX_BATCH) {
+                    cb_nr_batch_sizes = -1;
+                    break;
+                }
+                cb_batch_sizes[i] = sizes[i];
+            }
+
+            if (cb_nr_batch_sizes <= 0) {
+                fprintf(stderr, "%s: invalid batch list -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        }
+        case OPT_ADAPTIVE:
+            opts->adaptive = optarg ? strtod(optarg, NULL) / 100 : 0.01;
+            if (opts->adaptive <= 0) {
+                fprintf(stderr, "%s: invalid error target -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_LOOP_MS:
+            opts->loop_ms = strtod(optarg, NULL);
+            if (opts->loop_ms <= 0) {
+                fprintf(stderr, "%s: invalid loop duration -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_BUDGET:
+            opts->budget_s = strtod(optarg, NULL);
+            if (opts->budget_s <= 0) {
+                fprintf(stderr, "%s: invalid time budget -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_SAVE_BASELINE:
+            cb_baseline_out = fopen(optarg, "w");
+            if (cb_baseline_out == NULL) {
+                fprintf(stderr, "failed to create baseline %s: %s\n", optarg, strerror(errno));
+                exit(1);
+            }
+
+            fprintf(cb_baseline_out, "# callbench baseline: group.name size batch count samples...\n");
+            opts->keep_samples = 1;
+            break;
+        case OPT_COMPARE:
+            if (cb_load_baseline(optarg) != 0) {
+                exit(1);
+            }
+            opts->keep_samples = 1;
+            break;
+        case OPT_THRESHOLD:
+            opts->threshold = strtod(optarg, NULL) / 100;
+            if (opts->threshold < 0) {
+                fprintf(stderr, "%s: invalid threshold -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_INLINE:
+            if (!opts->unroll)
+                opts->unroll = 1;
+            break;
+        case OPT_UNROLL:
+            opts->unroll = atoi(optarg);
+            if (cb_unroll_factors[cb_unroll_index(opts->unroll)] != opts->unroll) {
+                fprintf(stderr, "%s: invalid unroll factor -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_SECCOMP_LEN:
+            cb_seccomp_len = atoi(optarg);
+            if (cb_seccomp_len < 0 || cb_seccomp_len > MAX_SECCOMP_LEN) {
+                fprintf(stderr, "%s: invalid seccomp filter length -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_DURATION:
+            opts->duration_s = strtod(optarg, NULL);
+            if (opts->duration_s <= 0) {
+                fprintf(stderr, "%s: invalid duration -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_INTERVAL:
+            opts->interval_ms = strtod(optarg, NULL);
+            if (opts->interval_ms <= 0) {
+                fprintf(stderr, "%s: invalid interval -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_STRESS:
+            cb_nr_stressors = cb_parse_stressors(optarg);
+            if (cb_nr_stressors <= 0) {
+                fprintf(stderr, "%s: invalid stressor list -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_STORAGE:
+            cb_storage_path = optarg;
+            break;
+        case OPT_STORAGE_SIZE: {
+            char *end;
+            cb_storage_size = cb_parse_size(optarg, &end);
+            if (*end != '\0' || cb_storage_size <= 0) {
+                fprintf(stderr, "%s: invalid storage size -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
             break;
         }
+        case OPT_NUMA:
+            opts->numa = 1;
+            break;
+        case OPT_SPEC_CTRL:
+            opts->spec_ctrl = 1;
+            break;
+        case OPT_TRACE:
+            cb_trace_threshold_ns = strtod(optarg, NULL);
+            if (cb_trace_threshold_ns <= 0) {
+                fprintf(stderr, "%s: invalid trace threshold -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        case OPT_TRACE_RING:
+            cb_trace_ring_path = optarg;
+            break;
+        case OPT_EXEC:
+            cb_exec_path = optarg;
+            cb_exec_self = 0;
+            break;
+        case OPT_PREFAULT: {
+            char *end;
+            cb_prefault_size = cb_parse_size(optarg, &end);
+            if (*end != '\0' || cb_prefault_size < 0) {
+                fprintf(stderr, "%s: invalid prefault size -- '%s'\n", argv[0], optarg);
+                print_help(argv[0]);
+            }
+            break;
+        }
+        case OPT_PER_CALL:
+            opts->dist = 1;
+            opts->per_call = 1;
+            break;
+        }
+    }
+
+    if (opts->duration_s > 0 && (opts->threads || opts->keep_samples || opts->adaptive)) {
+        fprintf(stderr, "%s: --duration can't be combined with --threads, --adaptive or baselines\n", argv[0]);
+        print_help(argv[0]);
     }
+
+    if (opts->numa && (opts->threads || opts->duration_s > 0 || opts->keep_samples)) {
+        fprintf(stderr, "%s: --numa can't be combined with --threads, --duration or baselines\n", argv[0]);
+        print_help(argv[0]);
+    }
+
+    if (opts->spec_ctrl && (opts->threads || opts->duration_s > 0 || opts->keep_samples || opts->numa)) {
+        fprintf(stderr, "%s: --spec-ctrl can't be combined with --threads, --duration, --numa or baselines\n",
+            argv[0]);
+        print_help(argv[0]);
+    }
+
+    if (opts->keep_samples && opts->threads) {
+        fprintf(stderr, "%s: --save-baseline and --compare don't support --threads\n", argv[0]);
+        print_help(argv[0]);
+    }
+
+    if (!mode_set) {
+        cb_select_benchmarks("all");
+    }
+}
+
+// Prints a dot after every round so long runs visibly make progress
+static void print_progress(void *ctx) {
+    FILE *out = ctx;
+    fputc('.', out);
+    fflush(out);
+}
+
+static void print_timer(enum timer_type type) {
+    if (cb_output_format != FORMAT_TEXT) {
+        return;
+    }
+
+#ifdef HAVE_CYCLE_TIMER
+    if (type == TIMER_CYCLES)
+        printf("timer: cycle counter at %.3f MHz\n", 1000 / cb_timer_ns_per_tick);
+#endif
+    printf("timer overhead: %.2f ns\n\n", cb_timer_overhead_ns);
 }
 
 int main(int argc, char** argv) {
-    bool do_time = 1;
-    bool do_file = 1;
-    int calls = -1;
-    int loops = -1;
-    int rounds = -1;
+    if (argc == 2 && !strcmp(argv[1], EXEC_EXIT_ARG)) {
+        return 0;
+    }
 
-    parse_args(argc, argv, &do_time, &do_file, &calls, &loops, &rounds);
+    struct options opts = {
+        .calls = -1,
+        .loops = -1,
+        .rounds = -1,
+        .loop_ms = 10,
+        .budget_s = 10,
+        .threshold = 0.05,
+        .interval_ms = 100,
+    };
+
+    parse_args(argc, argv, &opts);
+
+    // Keep stdout clean for machine-readable output
+    callbench_set_progress(print_progress, cb_output_format == FORMAT_TEXT ? stdout : stderr);
+    cb_init_host_info();
+    if (cb_output_format == FORMAT_TEXT) {
+        cb_print_host_info();
+    }
+    if (cb_init_buffers() != 0 || cb_init_storage() != 0 || cb_init_prefault() != 0 || cb_init_isolation(&opts) != 0) {
+        cb_cleanup_storage();
+        exit(1);
+    }
+    cb_init_timer(opts.timer);
+    print_timer(opts.timer);
+    if (cb_init_trace() != 0) {
+        cb_cleanup_storage();
+        exit(1);
+    }
+    if (opts.numa) {
+        cb_init_numa_topology();
+    }
 
-    if (do_time) {
-        bench_time(calls, loops, rounds);
+    if (cb_start_stressors() != 0) {
+        cb_cleanup_storage();
+        cb_cleanup_trace();
+        exit(1);
     }
+    int ret = cb_run_groups(&opts);
+    cb_stop_stressors();
+    cb_cleanup_storage();
+    cb_cleanup_trace();
 
-    if (do_time && do_file) {
-        putchar('\n');
+    if (cb_baseline_out != NULL) {
+        fclose(cb_baseline_out);
     }
 
-    if (do_file) {
-        bench_file(calls, loops, rounds);
+    if (ret != 0) {
+        return 1;
     }
 
-    return 0;
+    return cb_regressed ? EXIT_REGRESSION : 0;
 }
@@ -0,0 +1,144 @@
+/*
+ * callbench.h
+ *
+ * Internals of libcallbench shared with the callbench command-line interface,
+ * which embedders should not rely on; see libcallbench.h instead.
+ * Everything here is prefixed with cb_ so that linking libcallbench.a can't
+ * clash with an embedder's own symbols.
+ *
+ * Licensed under the MIT License (MIT)
+ *
+ * Copyright (c) 2018-2020 Danny Lin <danny@kdrag0n.dev>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CALLBENCH_H
+#define CALLBENCH_H
+
+#include <stdio.h>
+
+#define TEST_READ_PATH "/dev/zero"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+#define HAVE_CYCLE_TIMER
+#endif
+
+// Two instructions per comparison, within the kernel's BPF_MAXINSNS of 4096
+#define MAX_SECCOMP_LEN 2040
+
+// Makes this program exit as soon as it starts, for timing exec of a trivial program
+#define EXEC_EXIT_ARG "--exec-exit"
+
+#define NR_UNROLL_FACTORS 3
+#define EXIT_REGRESSION 2
+
+#define MAX_THREADS 1024
+#define MAX_XFER_SIZES 64
+#define MAX_BATCH_SIZES 16
+#define MAX_BATCH 4096
+
+typedef _Bool bool;
+
+enum cb_output_format {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_CSV,
+};
+
+enum timer_type {
+    TIMER_CLOCK,
+    TIMER_CYCLES,
+};
+
+struct options {
+    int calls;
+    int loops;
+    int rounds;
+    bool dist;
+    bool per_call;
+    enum timer_type timer;
+    int threads;
+    int fifo_prio;
+    bool mlock;
+    bool perf;
+    double adaptive; // target relative error of the median, or 0 for fixed rounds
+    double loop_ms;
+    double budget_s;
+    bool keep_samples; // for --save-baseline and --compare
+    double threshold; // relative slowdown that counts as a regression
+    int unroll; // unroll factor for --inline, or 0 if disabled
+    double duration_s; // soak each benchmark for this long, or 0 for normal rounds
+    double interval_ms;
+    bool numa; // run every pair of CPU node and memory node
+    bool spec_ctrl; // rerun every benchmark under each speculation control
+};
+
+extern const char *cb_test_read_path;
+extern long cb_xfer_sizes[MAX_XFER_SIZES];
+extern int cb_nr_xfer_sizes;
+extern bool cb_xfer_sizes_set;
+extern int cb_batch_sizes[MAX_BATCH_SIZES];
+extern int cb_nr_batch_sizes;
+extern const char *cb_exec_path;
+extern bool cb_exec_self;
+extern long cb_prefault_size;
+extern const char *cb_storage_path;
+extern long cb_storage_size;
+extern int cb_seccomp_len;
+extern int cb_nr_stressors;
+extern enum cb_output_format cb_output_format;
+extern double cb_timer_overhead_ns;
+extern double cb_timer_ns_per_tick;
+extern FILE *cb_baseline_out;
+extern bool cb_regressed;
+extern int cb_warmup_ms;
+extern int cb_cpu_list[MAX_THREADS];
+extern int cb_nr_cpu_list;
+extern const int cb_unroll_factors[NR_UNROLL_FACTORS];
+extern double cb_trace_threshold_ns;
+extern const char *cb_trace_ring_path;
+
+long cb_parse_size(const char *str, char **end);
+int cb_parse_size_list(const char *list, long *sizes, int max);
+int cb_parse_cpu_list(const char *list, int *cpus, int max);
+int cb_parse_stressors(const char *arg);
+int cb_unroll_index(int unroll);
+int cb_select_benchmarks(const char *mode);
+void cb_list_benchmarks(void);
+int cb_load_baseline(const char *path);
+
+// Those returning int return 0 or a negative errno, after printing why they failed
+void cb_init_host_info(void);
+void cb_print_host_info(void);
+int cb_init_buffers(void);
+int cb_init_storage(void);
+int cb_init_prefault(void);
+int cb_init_isolation(struct options *opts);
+void cb_init_timer(enum timer_type type);
+void cb_init_numa_topology(void);
+int cb_init_trace(void);
+
+int cb_start_stressors(void);
+int cb_run_groups(struct options *opts);
+void cb_stop_stressors(void);
+void cb_cleanup_storage(void);
+void cb_cleanup_trace(void);
+
+#endif
@@ -0,0 +1,6907 @@
+/*
+ * libcallbench.c
+ *
+ * Timer backends, the benchmark registry and the measurement and reporting
+ * code behind callbench, usable in-process through libcallbench.h.
+ *
+ * Licensed under the MIT License (MIT)
+ *
+ * Copyright (c) 2018-2020 Danny Lin <danny@kdrag0n.dev>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <signal.h>
+#include <spawn.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <linux/errqueue.h>
+#include <sys/prctl.h>
+#include <linux/futex.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <linux/sched.h>
+#endif
+#include <stddef.h>
+#include <time.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <stdarg.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "libcallbench.h"
+#include "callbench.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#define HAVE_PERF_EVENTS
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define TEST_READ_LEN 65536
+#define HPAGE_SIZE (2 * 1024 * 1024)
+#define CACHE_LINE_SIZE 64
+
+#define NS_PER_SEC 1000000000
+#define NS_PER_MS 1000000
+
+// HDR-style histogram: each power of two is split into 2^HIST_SUB_BITS buckets
+#define HIST_SUB_BITS 2
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB_BUCKETS)
+#define HIST_BAR_WIDTH 40
+
+#if defined(__linux__)
+#define CLOCK_GETTIME_SYSCALL_NR __NR_clock_gettime
+#elif defined(__APPLE__)
+// macOS does not allow direct syscalls that bypass libSystem.dylib
+#define NO_DIRECT_SYSCALL
+#elif defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+#define CLOCK_GETTIME_SYSCALL_NR SYS_clock_gettime
+#elif defined(__NetBSD__)
+#define CLOCK_GETTIME_SYSCALL_NR SYS___clock_gettime50
+#else
+#error Unsupported platform: missing clock_gettime syscall number!
+#endif
+
+// Unaffected by NTP slewing, so it's the best reference for calibration
+#ifdef CLOCK_MONOTONIC_RAW
+#define CALIBRATION_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define CALIBRATION_CLOCK CLOCK_MONOTONIC
+#endif
+
+#define CALIBRATION_NS (NS_PER_SEC / 50)
+#define CALIBRATION_RUNS 5
+#if defined(__x86_64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#elif defined(__i386__)
+#define SECCOMP_AUDIT_ARCH AUDIT_ARCH_I386
+#endif
+
+// Start of the values seccomp filters compare against, which no syscall or argument uses
+#define SECCOMP_NO_MATCH 0x5ec00000
+
+// Small messages like RPC requests, and batches bounded by the UDP receive buffer
+#define NET_MSG_SIZE 64
+#define NET_MAX_BATCH 1024
+#define NET_SOCK_BUF (4 * 1024 * 1024)
+#define NET_MAX_ZC_PENDING 64
+#define NET_MAX_STREAM (NET_SOCK_BUF / 4)
+
+#define STORAGE_FILE_SIZE (256L * 1024 * 1024)
+#define STORAGE_MAX_INFLIGHT (256L * 1024 * 1024)
+
+#define MAX_STRESSORS 64
+// Larger than typical last-level caches so the memory stressor goes to DRAM
+#define STRESS_MEM_SIZE (64 * 1024 * 1024)
+#define STRESS_FAULT_SIZE (2 * 1024 * 1024)
+
+// Lock handoffs each thread records for latency percentiles, about 8 MiB
+#define HANDOFF_MAX_SAMPLES (1 << 20)
+#define SYNC_WAITV_LEN 8
+
+#define MIN_ADAPTIVE_ROUNDS 3
+#define BASELINE_KEY_LEN 320
+// Significance level for regressions in --compare
+#define COMPARE_ALPHA 0.01
+#define OVERHEAD_ROUNDS 2
+#define TIMER_OVERHEAD_RUNS 10000
+
+// Bits in the single-word node masks passed to set_mempolicy and mbind
+#define MAX_NUMA_NODES 64
+#define MAX_RECORD_FIELDS 96
+// Joins host_info lists; sysfs statuses such as spectre_v2's contain ';' but never '|'
+#define HOST_LIST_SEP "|"
+
+// Timed loops kept by --trace-ring before it wraps, 32 MiB of entries
+#define TRACE_RING_LEN (1 << 20)
+#define TRACE_RING_MAGIC "CBTRACE"
+#define TRACE_RING_VERSION 1
+// Set in trace_ring_entry.flags for loops slower than --trace
+#define TRACE_OUTLIER (1 << 0)
+// trace_ring_entry.bench for the empty loops that measure harness overhead
+#define TRACE_OVERHEAD UINT32_MAX
+
+// Indices into perf_events, which lists one event per counter below
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define NR_PERF_EVENTS 7
+
+#define ARRAY_SIZE(arr) ((int) (sizeof(arr) / sizeof((arr)[0])))
+
+typedef void (*bench_impl)(void);
+typedef void (*bench_loop)(int calls);
+
+// Preallocated storage for per-loop (or per-call) timings, in ns per call
+struct sample_buf {
+    double *ns;
+    long len;
+    long cap;
+    bool per_call;
+};
+
+struct bench_stats {
+    long count;
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double p999;
+    double max;
+    long hist[HIST_BUCKETS];
+};
+
+// Loop samples from --adaptive, with harness overhead subtracted
+struct bench_summary {
+    long count;
+    double mean;
+    double stddev;
+    double median;
+    double ci_lo; // 95% confidence interval on the median
+    double ci_hi;
+    long outliers; // beyond 1.5 IQR from the quartiles
+    int rounds;
+    bool converged;
+};
+
+struct bench_result {
+    double raw_ns;
+    double ns; // with harness overhead subtracted
+    struct bench_stats stats;
+    struct bench_summary summary;
+    double perf[NR_PERF_EVENTS]; // per call
+    bool perf_valid[NR_PERF_EVENTS];
+};
+
+struct perf_event_desc {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+struct perf_counters {
+    int fds[NR_PERF_EVENTS];
+    bool user_only;
+};
+
+struct bench_def;
+typedef int (*bench_hook)(const struct bench_def *def);
+
+// Moves xfer_size bytes per call, so it runs once for every --size
+#define BENCH_SIZED (1 << 0)
+// Performs batch_size operations per call, so it runs once for every --batch
+#define BENCH_BATCHED (1 << 1)
+// Shares state set up on the main thread, so it can't run with --threads
+#define BENCH_NO_THREADS (1 << 2)
+// Reports the cost per page of a sized benchmark
+#define BENCH_PAGED (1 << 3)
+// Runs on its own thread because its setup changes per-thread state that can't be undone
+#define BENCH_ISOLATED (1 << 4)
+// Without --size, runs once for every cache level and DRAM
+#define BENCH_CACHE_SWEEP (1 << 5)
+// Times lock handoffs between threads, reported with --threads
+#define BENCH_HANDOFF (1 << 6)
+
+// A vDSO call taking at least this fraction of its syscall's time is assumed to fall back to it
+#define VDSO_FALLBACK_RATIO 0.75
+
+// Zero-copy file benchmark kinds in bench_def.arg
+#define ZC_SENDFILE 0
+#define ZC_SPLICE 1
+#define ZC_VMSPLICE 2
+#define ZC_COPY_FILE_RANGE 3
+#define ZC_READ_WRITE 4
+
+// Instruction sets of bandwidth kernels in bench_def.arg, for checking CPU support
+#define BW_BASE 0
+#define BW_AVX2 1
+#define BW_AVX512 2
+
+// Storage benchmark variants in bench_def.arg
+#define STORAGE_DIRECT (1 << 0)
+
+// Socket benchmark kinds in bench_def.arg
+#define NET_UNIX 0
+#define NET_UDP 1
+#define NET_UDP_MMSG 2
+#define NET_TCP 3
+#define NET_TCP_ZEROCOPY 4
+#define NET_EPOLL 5
+#define NET_KIND_MASK 0xff
+
+// seccomp benchmark variants in bench_def.arg
+#define SECCOMP_CHECK_ARGS (1 << 0)
+
+// io_uring benchmark variants in bench_def.arg
+#define URING_READ (1 << 0)
+#define URING_SQPOLL (1 << 1)
+
+// IPC benchmark mechanism and peer placement in bench_def.arg
+#define IPC_PIPE 0
+#define IPC_EVENTFD 1
+#define IPC_FUTEX 2
+#define IPC_YIELD 3
+#define IPC_KIND_MASK 0xff
+#define IPC_SAME_CPU (0 << 8)
+#define IPC_CROSS_CPU (1 << 8)
+#define IPC_CROSS_NODE (2 << 8)
+#define IPC_PLACEMENT_MASK 0xff00
+
+#ifndef PR_SPEC_L1D_FLUSH
+#define PR_SPEC_L1D_FLUSH 2
+#endif
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+#define FUTEX_PING 1
+#define FUTEX_PONG 2
+
+struct bench_def {
+    const char *name;
+    const char *group;
+    const char *desc;
+    int calls;
+    int loops;
+    int rounds;
+    bench_hook setup; // returns nonzero if unsupported
+    void (*teardown)(const struct bench_def *def);
+    bench_impl impl; // NULL if unsupported on this platform
+    long arg; // for benchmarks sharing an impl
+    unsigned int flags;
+    const char *syscall_ref; // direct syscall equivalent of a vDSO call in the same group
+    const bench_loop *inlined; // impl inlined into loops unrolled by each of cb_unroll_factors
+};
+
+#ifdef HAVE_IO_URING
+struct uring {
+    int fd;
+    bool sqpoll;
+    unsigned sq_entries;
+    unsigned sq_mask;
+    unsigned cq_mask;
+    atomic_uint *sq_tail;
+    atomic_uint *sq_flags;
+    atomic_uint *cq_head;
+    atomic_uint *cq_tail;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+#endif
+
+#ifdef __linux__
+// Peer thread and channels for the IPC round trip benchmarks
+struct ipc_state {
+    pthread_t peer;
+    int peer_cpu;
+    int kind;
+    int ping_fds[2];
+    int pong_fds[2];
+    atomic_int futex_word;
+    atomic_bool stop;
+    cpu_set_t saved_mask;
+};
+#endif
+
+struct bench_group {
+    const char *name;
+    const char *title;
+};
+
+// Harness overhead last measured for a loop shape, reused by runs with the same one
+struct overhead_cache {
+    int calls;
+    int loops;
+    double ns;
+};
+
+// Result of --compare against the same run in a baseline
+struct bench_compare {
+    bool valid;
+    double base_median;
+    double delta; // relative change of the median
+    double p; // two-sided Mann-Whitney U p-value
+    bool regression;
+};
+
+// One benchmark at one transfer size, with everything needed to report it
+struct bench_run {
+    const struct bench_def *def;
+    long size; // bytes per operation, or 0 if not sized
+    int batch; // operations per call, or 0 if not batched
+    int calls;
+    int loops;
+    int rounds;
+    int threads;
+    bool supported;
+    int vdso_fallback; // 1 if a vDSO call is no faster than its syscall, -1 if unknown
+    double overhead_ns;
+    double calls_per_sec;
+    struct bench_result result;
+    struct sample_buf samples; // sorted and corrected, kept for --save-baseline and --compare
+    struct bench_compare compare;
+    bool inlined; // whether inline_* were measured with --inline
+    double inline_overhead_ns;
+    double inline_raw_ns;
+    double inline_ns;
+    int cpu_node; // indexes into numa_nodes with --numa, or -1
+    int mem_node;
+    struct bench_stats handoff; // lock handoff latency across threads, for BENCH_HANDOFF
+    int spec_ctrl; // indexes into spec_ctrls with --spec-ctrl, or -1
+    double spec_base_ns; // result without the control, or 0 if unknown
+};
+
+// A per-task speculation mitigation that prctl can turn on
+struct spec_ctrl {
+    const char *name;
+    int which;
+    int value; // PR_SPEC_DISABLE disables speculation, but PR_SPEC_ENABLE enables L1D flushing
+};
+
+// Start of a --trace-ring file, followed by the entries and then a name table
+struct trace_ring_header {
+    char magic[8]; // TRACE_RING_MAGIC
+    uint32_t version;
+    uint32_t timer; // enum timer_type of the timestamps, which are CLOCK_MONOTONIC ns for TIMER_CLOCK
+    double ns_per_tick;
+    uint64_t len; // entries in the ring
+    uint64_t head; // entries ever written, so the newest is at (head - 1) % len
+    uint64_t names_off; // "group.name" of each benchmark index, NUL-separated
+    uint64_t names_len;
+};
+
+// One timed loop, or one call with --per-call
+struct trace_ring_entry {
+    uint64_t begin; // raw timer values
+    uint64_t end;
+    uint32_t bench; // index into the name table, or TRACE_OVERHEAD
+    uint32_t calls;
+    uint32_t tid;
+    uint32_t flags;
+};
+
+struct numa_node {
+    int node;
+    int cpu; // first allowed CPU to run on, or -1 for memory-only nodes
+};
+
+struct spin_barrier {
+    atomic_int count;
+    atomic_int generation;
+    int total;
+    atomic_bool abort; // set by any worker that failed to start, so the rest skip timing
+};
+
+// Aligned so workers reporting results don't bounce each other's cache lines
+struct worker {
+    pthread_t thread;
+    int cpu;
+    const struct bench_def *def;
+    int calls;
+    int loops;
+    int rounds;
+    struct spin_barrier *barrier;
+    double ns;
+    int error;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct baseline_entry {
+    char key[BASELINE_KEY_LEN];
+    struct sample_buf samples; // sorted
+};
+
+enum stress_kind {
+    STRESS_CPU,
+    STRESS_MEM,
+    STRESS_SYSCALL,
+    STRESS_FAULT,
+};
+
+// Background load for --stress, on a CPU other than the benchmark's when possible
+struct stressor {
+    pthread_t thread;
+    enum stress_kind kind;
+    int cpu;
+    char *src; // for STRESS_MEM
+    char *dst;
+};
+
+struct host_info {
+    char kernel[256];
+    char machine[128];
+    char cpu_model[128];
+    char clocksource[64];
+    char mitigations[4096];
+    char thp[128];
+    char seccomp[16];
+    char pti[32];
+    char virtualization[64];
+    char spec_ctrl[256];
+    char cmdline[4096];
+};
+
+// One machine-readable output row; values are preformatted strings
+struct record {
+    int len;
+    const char *keys[MAX_RECORD_FIELDS];
+    char *vals[MAX_RECORD_FIELDS];
+    bool quoted[MAX_RECORD_FIELDS];
+};
+
+const char *cb_test_read_path = TEST_READ_PATH;
+static long read_buf_size;
+static long xfer_size = TEST_READ_LEN;
+long cb_xfer_sizes[MAX_XFER_SIZES] = { TEST_READ_LEN };
+int cb_nr_xfer_sizes = 1;
+bool cb_xfer_sizes_set;
+// Sizes that fit in half of L1d, L2 and LLC, leaving room for the other buffer, and 2x LLC for DRAM
+static long cache_sweep_sizes[4] = { 16 * 1024, 256 * 1024, 4 * 1024 * 1024, 128 * 1024 * 1024 };
+static int batch_size = 1;
+int cb_batch_sizes[MAX_BATCH_SIZES] = { 1, 8, 32 };
+int cb_nr_batch_sizes = 3;
+
+// State opened by setup hooks so only the operation itself is timed, per thread so
+// workers don't share buffers or kernel objects
+static __thread char *test_read_buf;
+static __thread int bench_fd = -1;
+static __thread char *bench_map;
+#ifdef HAVE_IO_URING
+static __thread struct uring bench_ring = { .fd = -1 };
+#endif
+static __thread clockid_t bench_clock = CLOCK_MONOTONIC;
+#ifdef __linux__
+static __thread int zc_pipe[2] = { -1, -1 };
+static __thread int zc_sink_fd = -1;
+static __thread long zc_pipe_size;
+static __thread int storage_fd = -1;
+static __thread uint64_t storage_rng;
+static __thread char *storage_bufs;
+static __thread char *bw_src;
+static __thread char *bw_dst;
+const char *cb_exec_path = "/proc/self/exe";
+bool cb_exec_self = 1;
+long cb_prefault_size;
+const char *cb_storage_path;
+long cb_storage_size = STORAGE_FILE_SIZE;
+static bool storage_created;
+static __thread int net_fds[2] = { -1, -1 };
+static __thread int net_epoll_fd = -1;
+static __thread struct mmsghdr *net_msgs;
+static __thread struct iovec *net_iovs;
+static __thread long net_zc_pending;
+#endif
+int cb_seccomp_len = 64;
+static struct stressor stressors[MAX_STRESSORS];
+int cb_nr_stressors;
+static atomic_bool stressors_stop;
+#ifdef __linux__
+static struct ipc_state ipc;
+#endif
+static long page_size;
+
+static bool progress = 1;
+static callbench_progress_fn progress_fn;
+static void *progress_ctx;
+enum cb_output_format cb_output_format = FORMAT_TEXT;
+static struct host_info host_info;
+
+#ifdef __linux__
+static const struct spec_ctrl spec_ctrls[] = {
+    { "ssbd", PR_SPEC_STORE_BYPASS, PR_SPEC_DISABLE },
+    { "stibp_ibpb", PR_SPEC_INDIRECT_BRANCH, PR_SPEC_DISABLE },
+    { "l1d_flush", PR_SPEC_L1D_FLUSH, PR_SPEC_ENABLE },
+};
+#define NR_SPEC_CTRLS ARRAY_SIZE(spec_ctrls)
+#else
+static const struct spec_ctrl spec_ctrls[1];
+#define NR_SPEC_CTRLS 0
+#endif
+double cb_timer_overhead_ns;
+FILE *cb_baseline_out;
+static struct baseline_entry *baseline;
+static int nr_baseline;
+bool cb_regressed;
+
+// --trace threshold in ns per call, or 0 to not write trace_marker events
+double cb_trace_threshold_ns;
+const char *cb_trace_ring_path;
+static int trace_marker_fd = -1;
+static struct trace_ring_header *trace_ring;
+static struct trace_ring_entry *trace_entries;
+static bool tracing;
+static uint64_t trace_seq; // loops timed without a ring, which counts them in its head instead
+static atomic_long trace_outliers;
+// Benchmark being timed, or NULL for the harness overhead
+static const struct bench_def *trace_def;
+static __thread uint32_t trace_tid;
+
+// Counters to enable only around timed loops, for the benchmark running on this thread
+static __thread struct perf_counters *active_perf;
+// Specialized loop to time instead of calling through bench_impl, for --inline
+static __thread bench_loop active_loop;
+int cb_warmup_ms = 125;
+
+// CPUs requested with --cpu; empty means any CPU in the affinity mask
+int cb_cpu_list[MAX_THREADS];
+int cb_nr_cpu_list;
+static struct numa_node numa_nodes[MAX_NUMA_NODES];
+static int nr_numa_nodes;
+
+static enum timer_type timer_type = TIMER_CLOCK;
+double cb_timer_ns_per_tick = 1.0;
+
+static long ts_to_ns(struct timespec ts) {
+    return ts.tv_nsec + (ts.tv_sec * NS_PER_SEC);
+}
+
+static long clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts_to_ns(ts);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// lfence keeps earlier instructions from drifting past the start timestamp
+static inline uint64_t cycles_begin(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("lfence\n\trdtsc" : "=a" (lo), "=d" (hi) :: "memory");
+    return ((uint64_t) hi << 32) | lo;
+}
+
+// rdtscp waits for prior instructions, lfence keeps later ones from starting early
+static inline uint64_t cycles_end(void) {
+    uint32_t lo, hi, aux;
+    __asm__ volatile("rdtscp\n\tlfence" : "=a" (lo), "=d" (hi), "=c" (aux) :: "memory");
+    return ((uint64_t) hi << 32) | lo;
+}
+#elif defined(__aarch64__)
+static inline uint64_t cycles_begin(void) {
+    uint64_t val;
+    __asm__ volatile("isb\n\tmrs %0, cntvct_el0" : "=r" (val) :: "memory");
+    return val;
+}
+
+static inline uint64_t cycles_end(void) {
+    uint64_t val;
+    __asm__ volatile("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r" (val) :: "memory");
+    return val;
+}
+#endif
+
+static inline uint64_t timer_begin(void) {
+#ifdef HAVE_CYCLE_TIMER
+    if (timer_type == TIMER_CYCLES)
+        return cycles_begin();
+#endif
+
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+static inline uint64_t timer_end(void) {
+#ifdef HAVE_CYCLE_TIMER
+    if (timer_type == TIMER_CYCLES)
+        return cycles_end();
+#endif
+
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+static inline double timer_elapsed_ns(uint64_t before, uint64_t after) {
+    if (timer_type == TIMER_CLOCK)
+        return after - before;
+
+    return (after - before) * cb_timer_ns_per_tick;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+#ifdef HAVE_CYCLE_TIMER
+// Measures the counter frequency against the raw monotonic clock
+static void calibrate_cycles(void) {
+    double ns_per_tick[CALIBRATION_RUNS];
+
+    for (int i = 0; i < CALIBRATION_RUNS; i++) {
+        long start_ns = clock_ns(CALIBRATION_CLOCK);
+        uint64_t start_ticks = cycles_begin();
+
+        long end_ns;
+        do {
+            end_ns = clock_ns(CALIBRATION_CLOCK);
+        } while (end_ns - start_ns < CALIBRATION_NS);
+        uint64_t end_ticks = cycles_end();
+
+        ns_per_tick[i] = (double) (end_ns - start_ns) / (end_ticks - start_ticks);
+    }
+
+    qsort(ns_per_tick, CALIBRATION_RUNS, sizeof(*ns_per_tick), cmp_double);
+    cb_timer_ns_per_tick = ns_per_tick[CALIBRATION_RUNS / 2];
+}
+#endif
+
+// Cost of reading the timer once at the start and once at the end of a timed region
+static double measure_timer_overhead(void) {
+    double best_ns = HUGE_VAL;
+
+    for (int i = 0; i < TIMER_OVERHEAD_RUNS; i++) {
+        uint64_t before = timer_begin();
+        uint64_t after = timer_end();
+
+        double elapsed_ns = timer_elapsed_ns(before, after);
+        if (elapsed_ns < best_ns) {
+            best_ns = elapsed_ns;
+        }
+    }
+
+    return best_ns;
+}
+
+void cb_init_timer(enum timer_type type) {
+    timer_type = type;
+
+#ifdef HAVE_CYCLE_TIMER
+    if (type == TIMER_CYCLES) {
+        calibrate_cycles();
+    }
+#endif
+
+    cb_timer_overhead_ns = measure_timer_overhead();
+}
+
+static int read_sysfs_line(const char *path, char *buf, int len) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    if (fgets(buf, len, f) == NULL) {
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static int pin_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    return 0;
+#endif
+}
+
+// Lists the CPUs requested with --cpu, or else all CPUs this process may run on
+static int get_cpus(int *cpus, int max) {
+    int count = 0;
+
+    if (cb_nr_cpu_list > 0) {
+        memcpy(cpus, cb_cpu_list, cb_nr_cpu_list * sizeof(*cpus));
+        return cb_nr_cpu_list;
+    }
+
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && count < max; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus[count++] = cpu;
+            }
+        }
+    }
+#endif
+
+    if (count == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int cpu = 0; cpu < online && count < max; cpu++) {
+            cpus[count++] = cpu;
+        }
+    }
+
+    return count;
+}
+
+// Statement repetition for the unrolled --inline loops
+#define REPEAT4(x) x; x; x; x
+#define REPEAT8(x) REPEAT4(x); REPEAT4(x)
+
+// Generates impl##_inline, loops that call impl directly without dispatch through bench_impl.
+// flatten inlines impl and its static callees, leaving only the operation and the loop counter.
+#define DEFINE_INLINE_LOOPS(impl) \
+    __attribute__((flatten)) static void impl##_loop1(int calls) { \
+        for (int call = 0; call < calls; call++) { \
+            impl(); \
+        } \
+    } \
+    __attribute__((flatten)) static void impl##_loop4(int calls) { \
+        int call = 0; \
+        for (; call + 4 <= calls; call += 4) { \
+            REPEAT4(impl()); \
+        } \
+        for (; call < calls; call++) { \
+            impl(); \
+        } \
+    } \
+    __attribute__((flatten)) static void impl##_loop8(int calls) { \
+        int call = 0; \
+        for (; call + 8 <= calls; call += 8) { \
+            REPEAT8(impl()); \
+        } \
+        for (; call < calls; call++) { \
+            impl(); \
+        } \
+    } \
+    static const bench_loop impl##_inline[NR_UNROLL_FACTORS] = { impl##_loop1, impl##_loop4, impl##_loop8 }
+
+const int cb_unroll_factors[NR_UNROLL_FACTORS] = { 1, 4, 8 };
+
+// Selects the clock for the time benchmarks, which are unsupported if the kernel lacks it
+static int clock_setup(const struct bench_def *def) {
+    struct timespec ts;
+    bench_clock = def->arg;
+    return clock_getres(bench_clock, &ts);
+}
+
+#ifdef NO_DIRECT_SYSCALL
+#define time_syscall_mb NULL
+#define time_syscall_mb_inline NULL
+#define getpid_syscall_mb NULL
+#define getpid_syscall_mb_inline NULL
+#else
+static void time_syscall_mb(void) {
+    struct timespec ts;
+    syscall(CLOCK_GETTIME_SYSCALL_NR, bench_clock, &ts);
+}
+DEFINE_INLINE_LOOPS(time_syscall_mb);
+#endif
+
+static void time_libc_mb(void) {
+    struct timespec ts;
+    clock_gettime(bench_clock, &ts);
+}
+DEFINE_INLINE_LOOPS(time_libc_mb);
+
+static void getres_libc_mb(void) {
+    struct timespec ts;
+    clock_getres(bench_clock, &ts);
+}
+DEFINE_INLINE_LOOPS(getres_libc_mb);
+
+static void gettimeofday_libc_mb(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+}
+DEFINE_INLINE_LOOPS(gettimeofday_libc_mb);
+
+static void time_t_libc_mb(void) {
+    time(NULL);
+}
+DEFINE_INLINE_LOOPS(time_t_libc_mb);
+
+#ifdef __linux__
+static void getres_syscall_mb(void) {
+    struct timespec ts;
+    syscall(__NR_clock_getres, bench_clock, &ts);
+}
+DEFINE_INLINE_LOOPS(getres_syscall_mb);
+
+static void gettimeofday_syscall_mb(void) {
+    struct timeval tv;
+    syscall(__NR_gettimeofday, &tv, NULL);
+}
+DEFINE_INLINE_LOOPS(gettimeofday_syscall_mb);
+
+static void getcpu_syscall_mb(void) {
+    unsigned int cpu, node;
+    syscall(__NR_getcpu, &cpu, &node, NULL);
+}
+DEFINE_INLINE_LOOPS(getcpu_syscall_mb);
+#else
+#define getres_syscall_mb NULL
+#define getres_syscall_mb_inline NULL
+#define gettimeofday_syscall_mb NULL
+#define gettimeofday_syscall_mb_inline NULL
+#define getcpu_syscall_mb NULL
+#define getcpu_syscall_mb_inline NULL
+#endif
+
+// Not all architectures have time(2), e.g. arm64 only provides it in the vDSO
+#ifdef __NR_time
+static void time_t_syscall_mb(void) {
+    syscall(__NR_time, NULL);
+}
+DEFINE_INLINE_LOOPS(time_t_syscall_mb);
+#else
+#define time_t_syscall_mb NULL
+#define time_t_syscall_mb_inline NULL
+#endif
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 29)
+static void getcpu_libc_mb(void) {
+    unsigned int cpu, node;
+    getcpu(&cpu, &node);
+}
+DEFINE_INLINE_LOOPS(getcpu_libc_mb);
+#else
+#define getcpu_libc_mb NULL
+#define getcpu_libc_mb_inline NULL
+#endif
+
+#ifndef NO_DIRECT_SYSCALL
+static void getpid_syscall_mb(void) {
+    syscall(__NR_getpid);
+}
+DEFINE_INLINE_LOOPS(getpid_syscall_mb);
+#endif
+
+// Syscalls without libc's syscall(2) wrapper, so only the entry instruction and kernel path are timed
+#if defined(__linux__) && defined(__x86_64__)
+#define HAVE_RAW_SYSCALL
+static inline long raw_syscall0(long nr) {
+    long ret;
+    __asm__ volatile("syscall" : "=a" (ret) : "a" (nr) : "rcx", "r11", "memory");
+    return ret;
+}
+#elif defined(__linux__) && defined(__aarch64__)
+#define HAVE_RAW_SYSCALL
+static inline long raw_syscall0(long nr) {
+    register long x8 __asm__("x8") = nr;
+    register long x0 __asm__("x0");
+    __asm__ volatile("svc #0" : "=r" (x0) : "r" (x8) : "memory");
+    return x0;
+}
+#elif defined(__linux__) && defined(__i386__)
+#define HAVE_RAW_SYSCALL
+static inline long raw_syscall0(long nr) {
+    long ret;
+    __asm__ volatile("int $0x80" : "=a" (ret) : "a" (nr) : "memory");
+    return ret;
+}
+#endif
+
+#ifdef HAVE_RAW_SYSCALL
+static void getpid_asm_mb(void) {
+    raw_syscall0(__NR_getpid);
+}
+DEFINE_INLINE_LOOPS(getpid_asm_mb);
+
+// The kernel returns -ENOSYS for -1 without dispatching to any handler
+static void nosys_asm_mb(void) {
+    raw_syscall0(-1);
+}
+DEFINE_INLINE_LOOPS(nosys_asm_mb);
+#else
+#define getpid_asm_mb NULL
+#define getpid_asm_mb_inline NULL
+#define nosys_asm_mb NULL
+#define nosys_asm_mb_inline NULL
+#endif
+
+#if defined(__linux__) && defined(__x86_64__)
+#define IA32_NR_GETPID 20
+
+// The legacy 32-bit entry path, which 64-bit processes can still use for compat syscalls
+static long int80_getpid(void) {
+    long ret;
+    __asm__ volatile("int $0x80" : "=a" (ret) : "a" (IA32_NR_GETPID) : "r8", "r9", "r10", "r11", "memory");
+    return ret;
+}
+
+static void int80_mb(void) {
+    int80_getpid();
+}
+DEFINE_INLINE_LOOPS(int80_mb);
+
+// Kernels without IA32 emulation fault on int 0x80, so try it in a child first
+static int int80_setup(const struct bench_def *def) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(int80_getpid() == getpid() ? 0 : 1);
+    } else if (pid < 0) {
+        return -1;
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+#else
+#define int80_mb NULL
+#define int80_mb_inline NULL
+#define int80_setup NULL
+#endif
+
+#if defined(HAVE_RAW_SYSCALL) && defined(SECCOMP_AUDIT_ARCH)
+// Installs a filter that compares against cb_seccomp_len syscall numbers or, if the benchmark
+// inspects arguments, values of the first argument, which kernels can't cache as always allowed
+static int seccomp_setup(const struct bench_def *def) {
+    bool check_args = def->arg & SECCOMP_CHECK_ARGS;
+    struct sock_filter *insns = calloc(cb_seccomp_len * 2 + 5, sizeof(*insns));
+    int len = 0;
+
+    if (insns == NULL) {
+        return -1;
+    }
+
+    // Check the architecture first like real profiles do
+    insns[len++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+    insns[len++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SECCOMP_AUDIT_ARCH, 1, 0);
+    insns[len++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS);
+    insns[len++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, check_args ?
+        offsetof(struct seccomp_data, args[0]) : offsetof(struct seccomp_data, nr));
+
+    // Values that never match, each followed by its denial so every comparison runs
+    for (int i = 0; i < cb_seccomp_len; i++) {
+        insns[len++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SECCOMP_NO_MATCH + i, 0, 1);
+        insns[len++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | EPERM);
+    }
+    insns[len++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+
+    struct sock_fprog prog = {
+        .len = len,
+        .filter = insns,
+    };
+
+    int ret = prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+    if (ret == 0) {
+        ret = syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, 0, &prog);
+    }
+    if (ret != 0) {
+        fprintf(stderr, "failed to install seccomp filter: %s\n", strerror(errno));
+    }
+
+    free(insns);
+    return ret;
+}
+#else
+#define seccomp_setup NULL
+#endif
+
+static void mmap_mb(void) {
+    int fd = open(cb_test_read_path, O_RDONLY);
+    long len = xfer_size;
+
+    void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    memcpy(test_read_buf, data, len);
+
+    munmap(data, len);
+    close(fd);
+}
+
+static void file_mb(void) {
+    int fd = open(cb_test_read_path, O_RDONLY);
+    long len = xfer_size;
+
+    read(fd, test_read_buf, len);
+
+    close(fd);
+}
+
+static void pread_mb(void) {
+    pread(bench_fd, test_read_buf, xfer_size, 0);
+}
+DEFINE_INLINE_LOOPS(pread_mb);
+
+// Reads one byte per page to take every page fault
+static void mmap_touch_mb(void) {
+    volatile char *data = mmap(NULL, xfer_size, PROT_READ, MAP_PRIVATE, bench_fd, 0);
+
+    for (long off = 0; off < xfer_size; off += page_size) {
+        (void) data[off];
+    }
+
+    munmap((void *) data, xfer_size);
+}
+
+static void memcpy_mb(void) {
+    memcpy(test_read_buf, bench_map, xfer_size);
+    __asm__ volatile("" :: "r" (test_read_buf) : "memory");
+}
+DEFINE_INLINE_LOOPS(memcpy_mb);
+
+// Makes sure every call can transfer xfer_size bytes from the test path
+static int path_setup(const struct bench_def *def) {
+    int fd = open(cb_test_read_path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s: %s\n", cb_test_read_path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    int ret = fstat(fd, &st);
+    close(fd);
+
+    if (ret == 0 && S_ISREG(st.st_mode) && st.st_size < xfer_size) {
+        fprintf(stderr, "%s is smaller than %ld bytes\n", cb_test_read_path, xfer_size);
+        return -1;
+    }
+
+    return ret;
+}
+
+// Some character devices can be read but not mapped
+static int mmap_path_setup(const struct bench_def *def) {
+    if (path_setup(def) != 0) {
+        return -1;
+    }
+
+    int fd = open(cb_test_read_path, O_RDONLY);
+    void *data = mmap(NULL, xfer_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    munmap(data, xfer_size);
+    return 0;
+}
+
+static int open_setup(const struct bench_def *def) {
+    if (path_setup(def) != 0) {
+        return -1;
+    }
+
+    bench_fd = open(cb_test_read_path, O_RDONLY);
+    return bench_fd < 0 ? -1 : 0;
+}
+
+static int open_mmap_setup(const struct bench_def *def) {
+    return mmap_path_setup(def) == 0 ? open_setup(def) : -1;
+}
+
+static void open_teardown(const struct bench_def *def) {
+    close(bench_fd);
+    bench_fd = -1;
+}
+
+// Maps and faults in the whole region up front
+static int map_setup(const struct bench_def *def) {
+    if (open_setup(def) != 0) {
+        return -1;
+    }
+
+    bench_map = mmap(NULL, xfer_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, bench_fd, 0);
+    if (bench_map == MAP_FAILED) {
+        open_teardown(def);
+        return -1;
+    }
+
+    memcpy(test_read_buf, bench_map, xfer_size);
+    return 0;
+}
+
+static void map_teardown(const struct bench_def *def) {
+    munmap(bench_map, xfer_size);
+    bench_map = NULL;
+    open_teardown(def);
+}
+
+#ifdef __linux__
+static void zc_close(void) {
+    for (int i = 0; i < 2; i++) {
+        if (zc_pipe[i] >= 0)
+            close(zc_pipe[i]);
+        zc_pipe[i] = -1;
+    }
+
+    if (zc_sink_fd >= 0)
+        close(zc_sink_fd);
+    zc_sink_fd = -1;
+}
+
+// Opens a sink on the same filesystem as --path, since copy_file_range can't cross filesystems
+static int open_sink_file(void) {
+    char *path = strdup(cb_test_read_path);
+    char *slash = strrchr(path, '/');
+    const char *dir = slash == NULL ? "." : slash == path ? "/" : (*slash = '\0', path);
+
+    int fd = open(dir, O_RDWR | O_TMPFILE, 0600);
+    free(path);
+    return fd;
+}
+
+// Pipes move up to their capacity per splice, so make room for a whole transfer if allowed
+static void grow_pipe(void) {
+    long size = xfer_size > page_size ? xfer_size : page_size;
+    zc_pipe_size = fcntl(zc_pipe[1], F_SETPIPE_SZ, size);
+    if (zc_pipe_size < 0) {
+        zc_pipe_size = fcntl(zc_pipe[1], F_GETPIPE_SZ);
+    }
+}
+
+// Moves len bytes from a pipe to the sink, which for /dev/null discards pages without touching them
+static void drain_pipe(long len) {
+    while (len > 0) {
+        ssize_t ret = splice(zc_pipe[0], NULL, zc_sink_fd, NULL, len, SPLICE_F_MOVE);
+        if (ret <= 0) {
+            return;
+        }
+        len -= ret;
+    }
+}
+
+static void sendfile_mb(void) {
+    off_t off = 0;
+    sendfile(zc_sink_fd, bench_fd, &off, xfer_size);
+}
+
+static void splice_mb(void) {
+    loff_t off = 0;
+
+    for (long left = xfer_size; left > 0;) {
+        ssize_t ret = splice(bench_fd, &off, zc_pipe[1], NULL, left < zc_pipe_size ? left : zc_pipe_size,
+            SPLICE_F_MOVE);
+        if (ret <= 0) {
+            return;
+        }
+
+        drain_pipe(ret);
+        left -= ret;
+    }
+}
+
+// Maps the user buffer into the pipe instead of copying it
+static void vmsplice_mb(void) {
+    for (long pos = 0; pos < xfer_size;) {
+        long len = xfer_size - pos < zc_pipe_size ? xfer_size - pos : zc_pipe_size;
+        struct iovec iov = {
+            .iov_base = test_read_buf + pos,
+            .iov_len = len,
+        };
+
+        ssize_t ret = vmsplice(zc_pipe[1], &iov, 1, 0);
+        if (ret <= 0) {
+            return;
+        }
+
+        drain_pipe(ret);
+        pos += ret;
+    }
+}
+
+static void copy_file_range_mb(void) {
+    loff_t in_off = 0, out_off = 0;
+
+    for (long left = xfer_size; left > 0;) {
+        ssize_t ret = copy_file_range(bench_fd, &in_off, zc_sink_fd, &out_off, left, 0);
+        if (ret <= 0) {
+            return;
+        }
+        left -= ret;
+    }
+}
+
+// The copying baseline for the same transfer into the same sink
+static void read_write_mb(void) {
+    pread(bench_fd, test_read_buf, xfer_size, 0);
+    write(zc_sink_fd, test_read_buf, xfer_size);
+}
+
+static int zc_setup(const struct bench_def *def) {
+    int kind = def->arg;
+    if (kind != ZC_VMSPLICE && open_setup(def) != 0) {
+        return -1;
+    }
+
+    int ret = 0;
+    if (kind == ZC_COPY_FILE_RANGE) {
+        zc_sink_fd = open_sink_file();
+        ret = zc_sink_fd < 0;
+    } else {
+        zc_sink_fd = open("/dev/null", O_WRONLY);
+        ret = zc_sink_fd < 0;
+    }
+
+    if (ret == 0 && (kind == ZC_SPLICE || kind == ZC_VMSPLICE)) {
+        ret = pipe(zc_pipe);
+        if (ret == 0) {
+            grow_pipe();
+        }
+    }
+
+    // Not every file supports every path, e.g. copy_file_range from /dev/zero, so try one byte
+    if (ret == 0 && kind != ZC_VMSPLICE && kind != ZC_READ_WRITE) {
+        loff_t in_off = 0, out_off = 0;
+        off_t off = 0;
+
+        if (kind == ZC_SENDFILE) {
+            ret = sendfile(zc_sink_fd, bench_fd, &off, 1) != 1;
+        } else if (kind == ZC_SPLICE) {
+            ret = splice(bench_fd, &in_off, zc_pipe[1], NULL, 1, 0) != 1;
+            // Draining an empty pipe would block with its write end still open
+            if (!ret)
+                drain_pipe(1);
+        } else {
+            ret = copy_file_range(bench_fd, &in_off, zc_sink_fd, &out_off, 1, 0) != 1;
+        }
+    }
+
+    if (ret != 0) {
+        zc_close();
+        if (kind != ZC_VMSPLICE)
+            open_teardown(def);
+    }
+
+    return ret;
+}
+
+static void zc_teardown(const struct bench_def *def) {
+    zc_close();
+    if (def->arg != ZC_VMSPLICE)
+        open_teardown(def);
+}
+#else
+#define sendfile_mb NULL
+#define splice_mb NULL
+#define vmsplice_mb NULL
+#define copy_file_range_mb NULL
+#define read_write_mb NULL
+#define zc_setup NULL
+#define zc_teardown NULL
+#endif
+
+static void anon_mmap_mb(void) {
+    void *data = mmap(NULL, xfer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    munmap(data, xfer_size);
+}
+
+// Writes one byte per page to take a minor fault on each
+static void touch_pages(volatile char *data, long len) {
+    for (long off = 0; off < len; off += page_size) {
+        data[off] = 1;
+    }
+}
+
+static void anon_fault_mb(void) {
+    void *data = mmap(NULL, xfer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    touch_pages(data, xfer_size);
+    munmap(data, xfer_size);
+}
+
+static void anon_populate_mb(void) {
+    void *data = mmap(NULL, xfer_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    munmap(data, xfer_size);
+}
+
+#ifdef MADV_HUGEPAGE
+// Over-allocates so a huge page aligned region can be faulted, subject to the THP policy
+static void thp_fault_mb(void) {
+    long len = xfer_size + HPAGE_SIZE;
+    char *data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char *aligned = (char *) (((uintptr_t) data + HPAGE_SIZE - 1) & ~(uintptr_t) (HPAGE_SIZE - 1));
+
+    madvise(aligned, xfer_size, MADV_HUGEPAGE);
+    touch_pages(aligned, xfer_size);
+    munmap(data, len);
+}
+
+// Smaller sizes or ones that aren't huge page multiples would just measure normal faults
+static int thp_setup(const struct bench_def *def) {
+    return xfer_size % HPAGE_SIZE != 0;
+}
+#else
+#define thp_fault_mb NULL
+#define thp_setup NULL
+#endif
+
+// Drops the pages of the populated mapping, then faults them all back in
+static void dontneed_fault_mb(void) {
+    madvise(bench_map, xfer_size, MADV_DONTNEED);
+    touch_pages(bench_map, xfer_size);
+}
+
+// Alternates between read-only and read-write so every call changes the page tables
+static void mprotect_mb(void) {
+    static __thread bool writable = 1;
+
+    writable = !writable;
+    mprotect(bench_map, xfer_size, writable ? PROT_READ | PROT_WRITE : PROT_READ);
+}
+
+static int anon_map_setup(const struct bench_def *def) {
+    bench_map = mmap(NULL, xfer_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (bench_map == MAP_FAILED) {
+        perror("failed to map memory");
+        bench_map = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void anon_map_teardown(const struct bench_def *def) {
+    munmap(bench_map, xfer_size);
+    bench_map = NULL;
+}
+
+// Vector width that every bandwidth kernel's main loop works in; the rest goes through memcpy
+#define BW_CHUNK 64
+
+static void bw_tail_copy(char *dst, const char *src, long done) {
+    memcpy(dst + done, src + done, xfer_size - done);
+}
+
+static void bw_memcpy_mb(void) {
+    memcpy(bw_dst, bw_src, xfer_size);
+    __asm__ volatile("" :: "r" (bw_dst) : "memory");
+}
+
+static void bw_memset_mb(void) {
+    memset(bw_dst, 1, xfer_size);
+    __asm__ volatile("" :: "r" (bw_dst) : "memory");
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void copy_sse2_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    for (long off = 0; off < len; off += BW_CHUNK) {
+        for (int i = 0; i < BW_CHUNK; i += 16) {
+            __m128i v = _mm_load_si128((const __m128i *) (bw_src + off + i));
+            _mm_store_si128((__m128i *) (bw_dst + off + i), v);
+        }
+    }
+    bw_tail_copy(bw_dst, bw_src, len);
+}
+
+__attribute__((target("sse2")))
+static void stream_sse2_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    for (long off = 0; off < len; off += BW_CHUNK) {
+        for (int i = 0; i < BW_CHUNK; i += 16) {
+            __m128i v = _mm_load_si128((const __m128i *) (bw_src + off + i));
+            _mm_stream_si128((__m128i *) (bw_dst + off + i), v);
+        }
+    }
+    _mm_sfence();
+    bw_tail_copy(bw_dst, bw_src, len);
+}
+
+__attribute__((target("sse2")))
+static void stream_set_sse2_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    __m128i v = _mm_set1_epi8(1);
+    for (long off = 0; off < len; off += 16) {
+        _mm_stream_si128((__m128i *) (bw_dst + off), v);
+    }
+    _mm_sfence();
+    memset(bw_dst + len, 1, xfer_size - len);
+}
+
+__attribute__((target("avx2")))
+static void copy_avx2_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    for (long off = 0; off < len; off += BW_CHUNK) {
+        for (int i = 0; i < BW_CHUNK; i += 32) {
+            __m256i v = _mm256_load_si256((const __m256i *) (bw_src + off + i));
+            _mm256_store_si256((__m256i *) (bw_dst + off + i), v);
+        }
+    }
+    bw_tail_copy(bw_dst, bw_src, len);
+}
+
+__attribute__((target("avx2")))
+static void stream_avx2_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    for (long off = 0; off < len; off += BW_CHUNK) {
+        for (int i = 0; i < BW_CHUNK; i += 32) {
+            __m256i v = _mm256_load_si256((const __m256i *) (bw_src + off + i));
+            _mm256_stream_si256((__m256i *) (bw_dst + off + i), v);
+        }
+    }
+    _mm_sfence();
+    bw_tail_copy(bw_dst, bw_src, len);
+}
+
+__attribute__((target("avx512f")))
+static void copy_avx512_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    for (long off = 0; off < len; off += BW_CHUNK) {
+        __m512i v = _mm512_load_si512((const void *) (bw_src + off));
+        _mm512_store_si512((void *) (bw_dst + off), v);
+    }
+    bw_tail_copy(bw_dst, bw_src, len);
+}
+
+__attribute__((target("avx512f")))
+static void stream_avx512_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    for (long off = 0; off < len; off += BW_CHUNK) {
+        __m512i v = _mm512_load_si512((const void *) (bw_src + off));
+        _mm512_stream_si512((void *) (bw_dst + off), v);
+    }
+    _mm_sfence();
+    bw_tail_copy(bw_dst, bw_src, len);
+}
+
+#define copy_neon_mb NULL
+#define stream_neon_mb NULL
+#elif defined(__aarch64__)
+static void copy_neon_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    for (long off = 0; off < len; off += BW_CHUNK) {
+        for (int i = 0; i < BW_CHUNK; i += 16) {
+            vst1q_u8((uint8_t *) bw_dst + off + i, vld1q_u8((const uint8_t *) bw_src + off + i));
+        }
+    }
+    bw_tail_copy(bw_dst, bw_src, len);
+}
+
+// NEON has no streaming store intrinsic, so use STNP's non-temporal hint directly
+static void stream_neon_mb(void) {
+    long len = xfer_size / BW_CHUNK * BW_CHUNK;
+    for (long off = 0; off < len; off += BW_CHUNK) {
+        for (int i = 0; i < BW_CHUNK; i += 32) {
+            uint8x16_t a = vld1q_u8((const uint8_t *) bw_src + off + i);
+            uint8x16_t b = vld1q_u8((const uint8_t *) bw_src + off + i + 16);
+            __asm__ volatile("stnp %q0, %q1, [%2]" :: "w" (a), "w" (b), "r" (bw_dst + off + i) : "memory");
+        }
+    }
+    bw_tail_copy(bw_dst, bw_src, len);
+}
+
+#define copy_sse2_mb NULL
+#define stream_sse2_mb NULL
+#define stream_set_sse2_mb NULL
+#define copy_avx2_mb NULL
+#define stream_avx2_mb NULL
+#define copy_avx512_mb NULL
+#define stream_avx512_mb NULL
+#else
+#define copy_sse2_mb NULL
+#define stream_sse2_mb NULL
+#define stream_set_sse2_mb NULL
+#define copy_avx2_mb NULL
+#define stream_avx2_mb NULL
+#define copy_avx512_mb NULL
+#define stream_avx512_mb NULL
+#define copy_neon_mb NULL
+#define stream_neon_mb NULL
+#endif
+
+// Maps fresh pages rather than reusing freed heap memory so they follow this thread's memory policy
+static char *bw_alloc(void) {
+    char *buf = mmap(NULL, xfer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "failed to map %ld-byte buffer: %s\n", xfer_size, strerror(errno));
+        return NULL;
+    }
+
+    memset(buf, 0, xfer_size);
+    return buf;
+}
+
+static void bw_free(void) {
+    if (bw_src != NULL)
+        munmap(bw_src, xfer_size);
+    if (bw_dst != NULL)
+        munmap(bw_dst, xfer_size);
+    bw_src = bw_dst = NULL;
+}
+
+// Gives each thread its own source and destination so they don't share cache lines
+static int bw_setup(const struct bench_def *def) {
+#if defined(__x86_64__) || defined(__i386__)
+    if ((def->arg == BW_AVX2 && !__builtin_cpu_supports("avx2")) ||
+            (def->arg == BW_AVX512 && !__builtin_cpu_supports("avx512f"))) {
+        return 1;
+    }
+#endif
+
+    bw_src = bw_alloc();
+    bw_dst = bw_alloc();
+    if (bw_src == NULL || bw_dst == NULL) {
+        bw_free();
+        return -1;
+    }
+
+    memset(bw_src, 1, xfer_size);
+    return 0;
+}
+
+static void bw_teardown(const struct bench_def *def) {
+    bw_free();
+}
+
+#ifdef HAVE_IO_URING
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void uring_free(struct uring *ring) {
+    if (ring->sqes != NULL)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring != NULL)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0)
+        close(ring->fd);
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static void *uring_map(int fd, size_t size, off_t offset) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static int uring_init(struct uring *ring, unsigned entries, bool sqpoll) {
+    struct io_uring_params params = {
+        .flags = sqpoll ? IORING_SETUP_SQPOLL : 0,
+        .sq_thread_idle = 1000,
+    };
+
+    memset(ring, 0, sizeof(*ring));
+    ring->sqpoll = sqpoll;
+    ring->fd = io_uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        fprintf(stderr, "io_uring_setup failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+            ring->sq_ring_size = ring->cq_ring_size;
+        ring->sq_ring = uring_map(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->sq_ring = uring_map(ring->fd, ring->sq_ring_size, IORING_OFF_SQ_RING);
+        ring->cq_ring = uring_map(ring->fd, ring->cq_ring_size, IORING_OFF_CQ_RING);
+    }
+    ring->sqes = uring_map(ring->fd, ring->sqes_size, IORING_OFF_SQES);
+
+    if (ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL) {
+        fprintf(stderr, "failed to map io_uring: %s\n", strerror(errno));
+        uring_free(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_entries = params.sq_entries;
+    ring->sq_tail = (atomic_uint *) (sq + params.sq_off.tail);
+    ring->sq_flags = (atomic_uint *) (sq + params.sq_off.flags);
+    ring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    ring->cq_head = (atomic_uint *) (cq + params.cq_off.head);
+    ring->cq_tail = (atomic_uint *) (cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    // Every call submits the same operations, so index each SQE once here
+    unsigned *array = (unsigned *) (sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        array[i] = i;
+    }
+
+    return 0;
+}
+
+// Submits batch_size prefilled SQEs and waits for all of their completions
+static int uring_submit_wait(struct uring *ring) {
+    unsigned tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+    atomic_store_explicit(ring->sq_tail, tail + batch_size, memory_order_release);
+
+    unsigned head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+    int ret = 0;
+
+    if (ring->sqpoll) {
+        // The kernel thread picks up submissions, so only wake it if it went idle
+        if (atomic_load_explicit(ring->sq_flags, memory_order_acquire) & IORING_SQ_NEED_WAKEUP)
+            ret = io_uring_enter(ring->fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+
+        while (atomic_load_explicit(ring->cq_tail, memory_order_acquire) - head < (unsigned) batch_size)
+            sched_yield();
+    } else {
+        ret = io_uring_enter(ring->fd, batch_size, batch_size, IORING_ENTER_GETEVENTS);
+    }
+
+    for (int i = 0; i < batch_size; i++) {
+        struct io_uring_cqe *cqe = &ring->cqes[(head + i) & ring->cq_mask];
+        if (cqe->res < 0)
+            ret = cqe->res;
+    }
+
+    atomic_store_explicit(ring->cq_head, head + batch_size, memory_order_release);
+    return ret;
+}
+
+static void uring_mb(void) {
+    uring_submit_wait(&bench_ring);
+}
+
+// Creates a ring for one batch and fills every SQE with the same NOP or read
+static int uring_setup(const struct bench_def *def) {
+    bool sqpoll = def->arg & URING_SQPOLL;
+    bool is_read = def->arg & URING_READ;
+
+    if (is_read && open_setup(def) != 0) {
+        return -1;
+    }
+
+    if (uring_init(&bench_ring, batch_size, sqpoll) != 0) {
+        if (is_read)
+            open_teardown(def);
+        return -1;
+    }
+
+    for (unsigned i = 0; i < bench_ring.sq_entries; i++) {
+        struct io_uring_sqe *sqe = &bench_ring.sqes[i];
+        memset(sqe, 0, sizeof(*sqe));
+
+        if (is_read) {
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = bench_fd;
+            sqe->addr = (unsigned long) test_read_buf;
+            sqe->len = xfer_size;
+        } else {
+            sqe->opcode = IORING_OP_NOP;
+        }
+    }
+
+    // Check that the kernel accepts the operation before timing it
+    int ret = uring_submit_wait(&bench_ring);
+    if (ret < 0) {
+        fprintf(stderr, "io_uring %s failed: %s\n", def->name, strerror(-ret));
+        uring_free(&bench_ring);
+        if (is_read)
+            open_teardown(def);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void uring_teardown(const struct bench_def *def) {
+    uring_free(&bench_ring);
+
+    if (def->arg & URING_READ) {
+        open_teardown(def);
+    }
+}
+#else
+#define uring_mb NULL
+#define uring_setup NULL
+#define uring_teardown NULL
+#endif
+
+#ifdef __linux__
+static void close_net(void) {
+    for (int i = 0; i < 2; i++) {
+        if (net_fds[i] >= 0)
+            close(net_fds[i]);
+        net_fds[i] = -1;
+    }
+
+    if (net_epoll_fd >= 0)
+        close(net_epoll_fd);
+    net_epoll_fd = -1;
+}
+
+// Bounded by the receive buffer, since the receiving socket must hold a whole batch
+static int net_alloc_msgs(void) {
+    int count = batch_size;
+    if (count > NET_MAX_BATCH) {
+        return -1;
+    }
+
+    net_msgs = calloc(count, sizeof(*net_msgs));
+    net_iovs = calloc(count, sizeof(*net_iovs));
+    if (net_msgs == NULL || net_iovs == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        net_iovs[i].iov_base = test_read_buf + (long) i * NET_MSG_SIZE % read_buf_size;
+        net_iovs[i].iov_len = NET_MSG_SIZE;
+        net_msgs[i].msg_hdr.msg_iov = &net_iovs[i];
+        net_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    return 0;
+}
+
+// Only root may exceed net.core.rmem_max and wmem_max, so fall back to the capped option
+static void set_sock_buf(int fd, int opt, int force_opt) {
+    int size = NET_SOCK_BUF;
+    if (setsockopt(fd, SOL_SOCKET, force_opt, &size, sizeof(size)) != 0) {
+        setsockopt(fd, SOL_SOCKET, opt, &size, sizeof(size));
+    }
+}
+
+static int udp_socket_pair(int fds[2]) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t len = sizeof(addr);
+
+    fds[0] = socket(AF_INET, SOCK_DGRAM, 0);
+    fds[1] = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fds[0] < 0 || fds[1] < 0) {
+        return -1;
+    }
+
+    set_sock_buf(fds[1], SO_RCVBUF, SO_RCVBUFFORCE);
+
+    if (bind(fds[1], (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+            getsockname(fds[1], (struct sockaddr *) &addr, &len) != 0) {
+        return -1;
+    }
+
+    // Connecting lets sendmmsg skip per-message addresses, like sendto with a cached route
+    return connect(fds[0], (struct sockaddr *) &addr, sizeof(addr));
+}
+
+static int tcp_socket_pair(int fds[2]) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t len = sizeof(addr);
+    int one = 1;
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        return -1;
+    }
+
+    int ret = -1;
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (fds[0] >= 0 && bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 &&
+            getsockname(listen_fd, (struct sockaddr *) &addr, &len) == 0 && listen(listen_fd, 1) == 0 &&
+            connect(fds[0], (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        fds[1] = accept(listen_fd, NULL, NULL);
+        ret = fds[1] < 0 ? -1 : 0;
+    }
+
+    close(listen_fd);
+    if (ret == 0) {
+        setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(fds[1], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        set_sock_buf(fds[0], SO_SNDBUF, SO_SNDBUFFORCE);
+        set_sock_buf(fds[1], SO_RCVBUF, SO_RCVBUFFORCE);
+    }
+
+    return ret;
+}
+
+static int net_setup(const struct bench_def *def) {
+    int ret;
+
+    // The same thread sends and then receives, so a send that doesn't fit in the buffers never returns
+    if (def->flags & BENCH_SIZED && xfer_size > NET_MAX_STREAM) {
+        return -1;
+    }
+
+    switch (def->arg & NET_KIND_MASK) {
+    case NET_UNIX:
+        ret = socketpair(AF_UNIX, SOCK_STREAM, 0, net_fds);
+        break;
+    case NET_UDP:
+        ret = udp_socket_pair(net_fds);
+        break;
+    case NET_UDP_MMSG:
+        ret = udp_socket_pair(net_fds) || net_alloc_msgs();
+        break;
+    case NET_TCP:
+        ret = tcp_socket_pair(net_fds);
+        break;
+    case NET_TCP_ZEROCOPY: {
+        int one = 1;
+        ret = tcp_socket_pair(net_fds) || setsockopt(net_fds[0], SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+        net_zc_pending = 0;
+        break;
+    }
+    case NET_EPOLL: {
+        struct epoll_event event = { .events = EPOLLIN };
+        ret = socketpair(AF_UNIX, SOCK_STREAM, 0, net_fds);
+        if (ret == 0) {
+            net_epoll_fd = epoll_create1(0);
+            ret = net_epoll_fd < 0 || epoll_ctl(net_epoll_fd, EPOLL_CTL_ADD, net_fds[1], &event);
+        }
+        break;
+    }
+    default:
+        ret = -1;
+    }
+
+    if (ret != 0) {
+        close_net();
+        free(net_msgs);
+        free(net_iovs);
+        net_msgs = NULL;
+        net_iovs = NULL;
+    }
+
+    return ret;
+}
+
+static void net_teardown(const struct bench_def *def) {
+    close_net();
+    free(net_msgs);
+    free(net_iovs);
+    net_msgs = NULL;
+    net_iovs = NULL;
+}
+
+static void recv_full(int fd, char *buf, long len) {
+    while (len > 0) {
+        ssize_t ret = recv(fd, buf, len, 0);
+        if (ret <= 0) {
+            return;
+        }
+
+        buf += ret;
+        len -= ret;
+    }
+}
+
+// Everything is on one thread, so each call is a send and a receive with no wakeup or context switch
+static void socket_mb(void) {
+    write(net_fds[0], test_read_buf, NET_MSG_SIZE);
+    read(net_fds[1], test_read_buf, NET_MSG_SIZE);
+}
+
+static void udp_mb(void) {
+    sendto(net_fds[0], test_read_buf, NET_MSG_SIZE, 0, NULL, 0);
+    recvfrom(net_fds[1], test_read_buf, NET_MSG_SIZE, 0, NULL, NULL);
+}
+
+static void udp_mmsg_mb(void) {
+    sendmmsg(net_fds[0], net_msgs, batch_size, 0);
+
+    // Waits for the first datagram and takes whatever else has arrived, until the batch is in
+    for (int received = 0; received < batch_size;) {
+        int ret = recvmmsg(net_fds[1], net_msgs + received, batch_size - received, MSG_WAITFORONE, NULL);
+        if (ret <= 0) {
+            return;
+        }
+        received += ret;
+    }
+}
+
+// A request and response of NET_MSG_SIZE bytes over a connected loopback pair
+static void tcp_rr_mb(void) {
+    send(net_fds[0], test_read_buf, NET_MSG_SIZE, 0);
+    recv_full(net_fds[1], test_read_buf, NET_MSG_SIZE);
+    send(net_fds[1], test_read_buf, NET_MSG_SIZE, 0);
+    recv_full(net_fds[0], test_read_buf, NET_MSG_SIZE);
+}
+
+static void tcp_stream_mb(void) {
+    send(net_fds[0], test_read_buf, xfer_size, 0);
+    recv_full(net_fds[1], test_read_buf, xfer_size);
+}
+
+// Reaps completion notifications as they arrive so pinned pages and optmem don't run out
+static void reap_zerocopy(bool wait) {
+    char control[128];
+
+    while (net_zc_pending > 0) {
+        struct msghdr msg = {
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+
+        if (recvmsg(net_fds[0], &msg, MSG_ERRQUEUE | (wait ? 0 : MSG_DONTWAIT)) < 0) {
+            if (errno == EAGAIN && wait) {
+                sched_yield();
+                continue;
+            }
+            return;
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *err = (struct sock_extended_err *) CMSG_DATA(cm);
+            if (err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                net_zc_pending -= err->ee_data - err->ee_info + 1;
+            }
+        }
+    }
+}
+
+// On loopback the kernel copies deferred zerocopy pages on receive, so this shows the notification cost
+static void tcp_zerocopy_mb(void) {
+    if (send(net_fds[0], test_read_buf, xfer_size, MSG_ZEROCOPY) > 0) {
+        net_zc_pending++;
+    }
+
+    recv_full(net_fds[1], test_read_buf, xfer_size);
+    reap_zerocopy(net_zc_pending >= NET_MAX_ZC_PENDING);
+}
+
+static void epoll_mb(void) {
+    struct epoll_event event;
+    epoll_wait(net_epoll_fd, &event, 1, 0);
+}
+DEFINE_INLINE_LOOPS(epoll_mb);
+#else
+#define socket_mb NULL
+#define udp_mb NULL
+#define udp_mmsg_mb NULL
+#define tcp_rr_mb NULL
+#define tcp_stream_mb NULL
+#define tcp_zerocopy_mb NULL
+#define epoll_mb NULL
+#define epoll_mb_inline NULL
+#define net_setup NULL
+#define net_teardown NULL
+#endif
+
+#ifdef __linux__
+// Creates the --storage file if it doesn't exist, filled with data so every block is allocated
+int cb_init_storage(void) {
+    if (cb_storage_path == NULL) {
+        return 0;
+    }
+
+    struct stat st;
+    if (stat(cb_storage_path, &st) == 0) {
+        cb_storage_size = st.st_size;
+        return 0;
+    }
+
+    int fd = open(cb_storage_path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "failed to create %s: %s\n", cb_storage_path, strerror(errno));
+        return -errno;
+    }
+
+    storage_created = 1;
+    for (long off = 0; off < cb_storage_size; off += read_buf_size) {
+        long len = cb_storage_size - off < read_buf_size ? cb_storage_size - off : read_buf_size;
+        memset(test_read_buf, (int) (off / read_buf_size), len);
+        if (pwrite(fd, test_read_buf, len, off) != len) {
+            int err = errno;
+            fprintf(stderr, "failed to write %s: %s\n", cb_storage_path, strerror(err));
+            close(fd);
+            return -err;
+        }
+    }
+
+    // Dirty pages can't be dropped from the page cache
+    fsync(fd);
+    close(fd);
+    return 0;
+}
+
+void cb_cleanup_storage(void) {
+    if (storage_created) {
+        unlink(cb_storage_path);
+    }
+}
+
+// Random offset aligned to the transfer size rounded up to a page, as O_DIRECT and mmap need
+static long storage_offset(void) {
+    long align = (xfer_size + page_size - 1) / page_size * page_size;
+
+    storage_rng ^= storage_rng << 13;
+    storage_rng ^= storage_rng >> 7;
+    storage_rng ^= storage_rng << 17;
+    return (long) (storage_rng % (uint64_t) ((cb_storage_size - xfer_size) / align + 1)) * align;
+}
+
+static void drop_range(long off) {
+    posix_fadvise(storage_fd, off, xfer_size, POSIX_FADV_DONTNEED);
+}
+
+static void cold_read_mb(void) {
+    long off = storage_offset();
+    drop_range(off);
+    pread(storage_fd, test_read_buf, xfer_size, off);
+}
+
+static void readahead_read_mb(void) {
+    long off = storage_offset();
+    drop_range(off);
+    readahead(storage_fd, off, xfer_size);
+    pread(storage_fd, test_read_buf, xfer_size, off);
+}
+
+static void mmap_cold_range(bool willneed) {
+    long off = storage_offset();
+    drop_range(off);
+
+    volatile char *data = mmap(NULL, xfer_size, PROT_READ, MAP_SHARED, storage_fd, off);
+    if (data == MAP_FAILED) {
+        return;
+    }
+
+    if (willneed) {
+        madvise((void *) data, xfer_size, MADV_WILLNEED);
+    }
+    for (long pos = 0; pos < xfer_size; pos += page_size) {
+        (void) data[pos];
+    }
+
+    munmap((void *) data, xfer_size);
+}
+
+static void mmap_cold_mb(void) {
+    mmap_cold_range(0);
+}
+
+static void mmap_willneed_mb(void) {
+    mmap_cold_range(1);
+}
+
+// Fails with EAGAIN since the range is never cached, so this is the cost of finding that out
+static void nowait_miss_mb(void) {
+    long off = storage_offset();
+    struct iovec iov = {
+        .iov_base = test_read_buf,
+        .iov_len = xfer_size,
+    };
+
+    drop_range(off);
+    preadv2(storage_fd, &iov, 1, off, RWF_NOWAIT);
+}
+
+static void direct_read_mb(void) {
+    pread(storage_fd, test_read_buf, xfer_size, storage_offset());
+}
+
+// Polls for completion if the device has poll queues, otherwise behaves like direct_read
+static void hipri_read_mb(void) {
+    struct iovec iov = {
+        .iov_base = test_read_buf,
+        .iov_len = xfer_size,
+    };
+
+    preadv2(storage_fd, &iov, 1, storage_offset(), RWF_HIPRI);
+}
+
+#ifdef HAVE_IO_URING
+// Keeps --batch reads in flight at once, each to its own random offset
+static void direct_uring_mb(void) {
+    unsigned tail = atomic_load_explicit(bench_ring.sq_tail, memory_order_relaxed);
+
+    for (int i = 0; i < batch_size; i++) {
+        bench_ring.sqes[(tail + i) & bench_ring.sq_mask].off = storage_offset();
+    }
+
+    uring_submit_wait(&bench_ring);
+}
+#else
+#define direct_uring_mb NULL
+#endif
+
+static int storage_setup(const struct bench_def *def) {
+    bool direct = def->arg & STORAGE_DIRECT;
+
+    if (cb_storage_path == NULL || xfer_size > cb_storage_size) {
+        return -1;
+    }
+
+    // O_DIRECT needs block-aligned sizes, and batched reads each get their own buffer
+    if (direct && xfer_size % page_size != 0) {
+        return -1;
+    }
+    if (def->flags & BENCH_BATCHED && xfer_size * batch_size > STORAGE_MAX_INFLIGHT) {
+        return -1;
+    }
+
+    storage_fd = open(cb_storage_path, O_RDONLY | (direct ? O_DIRECT : 0));
+    if (storage_fd < 0) {
+        fprintf(stderr, "failed to open %s%s: %s\n", cb_storage_path, direct ? " with O_DIRECT" : "", strerror(errno));
+        return -1;
+    }
+
+    storage_rng = (uint64_t) clock_ns(CLOCK_MONOTONIC) | 1;
+
+#ifdef HAVE_IO_URING
+    if (def->flags & BENCH_BATCHED) {
+        if (uring_init(&bench_ring, batch_size, 0) != 0) {
+            close(storage_fd);
+            return -1;
+        }
+
+        storage_bufs = NULL;
+        if (posix_memalign((void **) &storage_bufs, page_size, xfer_size * batch_size) != 0) {
+            uring_free(&bench_ring);
+            close(storage_fd);
+            return -1;
+        }
+
+        for (unsigned i = 0; i < bench_ring.sq_entries; i++) {
+            struct io_uring_sqe *sqe = &bench_ring.sqes[i];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = storage_fd;
+            sqe->addr = (unsigned long) (storage_bufs + i % batch_size * xfer_size);
+            sqe->len = xfer_size;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+static void storage_teardown(const struct bench_def *def) {
+#ifdef HAVE_IO_URING
+    if (def->flags & BENCH_BATCHED) {
+        uring_free(&bench_ring);
+        free(storage_bufs);
+        storage_bufs = NULL;
+    }
+#endif
+
+    close(storage_fd);
+    storage_fd = -1;
+}
+#else
+#define cb_init_storage()
+#define cb_cleanup_storage()
+#define cold_read_mb NULL
+#define readahead_read_mb NULL
+#define mmap_cold_mb NULL
+#define mmap_willneed_mb NULL
+#define nowait_miss_mb NULL
+#define direct_read_mb NULL
+#define hipri_read_mb NULL
+#define direct_uring_mb NULL
+#define storage_setup NULL
+#define storage_teardown NULL
+#endif
+
+static void fork_mb(void) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(0);
+    }
+
+    waitpid(pid, NULL, 0);
+}
+
+// The child borrows the parent's memory and stack until it exits
+static void vfork_mb(void) {
+    pid_t pid = vfork();
+    if (pid == 0) {
+        _exit(0);
+    }
+
+    waitpid(pid, NULL, 0);
+}
+
+static void spawn_exec_args(char **argv) {
+    argv[0] = (char *) cb_exec_path;
+    argv[1] = cb_exec_self ? EXEC_EXIT_ARG : NULL;
+    argv[2] = NULL;
+}
+
+static void posix_spawn_mb(void) {
+    char *argv[3];
+    pid_t pid;
+
+    spawn_exec_args(argv);
+    if (posix_spawn(&pid, cb_exec_path, NULL, NULL, argv, environ) == 0) {
+        waitpid(pid, NULL, 0);
+    }
+}
+
+static void fork_exec_mb(void) {
+    char *argv[3];
+    spawn_exec_args(argv);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execve(cb_exec_path, argv, environ);
+        _exit(127);
+    }
+
+    waitpid(pid, NULL, 0);
+}
+
+// Makes sure the exec benchmarks measure a successful exec and not just a failing one
+static int exec_setup(const struct bench_def *def) {
+    char *argv[3];
+    int status;
+    pid_t pid;
+
+    spawn_exec_args(argv);
+    if (posix_spawn(&pid, cb_exec_path, NULL, NULL, argv, environ) != 0 || waitpid(pid, &status, 0) != pid) {
+        fprintf(stderr, "failed to run %s\n", cb_exec_path);
+        return -1;
+    }
+
+    return !WIFEXITED(status) || WEXITSTATUS(status) == 127;
+}
+
+#if defined(__linux__) && defined(__NR_clone3) && (defined(__x86_64__) || defined(__aarch64__))
+// The child shares the parent's stack, so it exits straight from the syscall without touching it
+static long clone3_exit(struct clone_args *args) {
+#if defined(__x86_64__)
+    long ret;
+    __asm__ volatile(
+        "syscall\n\t"
+        "test %%rax, %%rax\n\t"
+        "jnz 1f\n\t"
+        "mov %[exit], %%eax\n\t"
+        "xor %%edi, %%edi\n\t"
+        "syscall\n"
+        "1:"
+        : "=a" (ret)
+        : "a" ((long) __NR_clone3), "D" (args), "S" (sizeof(*args)), [exit] "i" (__NR_exit)
+        : "rcx", "r11", "memory");
+    return ret;
+#else
+    register long x8 __asm__("x8") = __NR_clone3;
+    register long x0 __asm__("x0") = (long) args;
+    register long x1 __asm__("x1") = sizeof(*args);
+    __asm__ volatile(
+        "svc #0\n\t"
+        "cbnz x0, 1f\n\t"
+        "mov x8, %[exit]\n\t"
+        "svc #0\n"
+        "1:"
+        : "+r" (x0), "+r" (x8)
+        : "r" (x1), [exit] "i" (__NR_exit)
+        : "memory");
+    return x0;
+#endif
+}
+
+static void clone3_vm_mb(void) {
+    struct clone_args args = {
+        .flags = CLONE_VM,
+        .exit_signal = SIGCHLD,
+    };
+
+    long pid = clone3_exit(&args);
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+    }
+}
+
+// clone3 is newer than the other calls and may be blocked, e.g. by container seccomp profiles
+static int clone3_setup(const struct bench_def *def) {
+    struct clone_args args = {
+        .flags = CLONE_VM,
+        .exit_signal = SIGCHLD,
+    };
+
+    long pid = clone3_exit(&args);
+    if (pid < 0) {
+        fprintf(stderr, "clone3 failed: %s\n", strerror(-pid));
+        return -1;
+    }
+
+    waitpid(pid, NULL, 0);
+    return 0;
+}
+#else
+#define clone3_vm_mb NULL
+#define clone3_setup NULL
+#endif
+
+static void *thread_exit_main(void *arg) {
+    return arg;
+}
+
+static void pthread_create_mb(void) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, thread_exit_main, NULL) == 0) {
+        pthread_join(thread, NULL);
+    }
+}
+
+// Grows RSS with written anonymous memory so fork has that many page tables to copy
+int cb_init_prefault(void) {
+    if (cb_prefault_size == 0) {
+        return 0;
+    }
+
+    char *data = mmap(NULL, cb_prefault_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "failed to map %ld bytes to prefault: %s\n", cb_prefault_size, strerror(errno));
+        return -errno;
+    }
+
+    for (long off = 0; off < cb_prefault_size; off += page_size) {
+        data[off] = 1;
+    }
+
+    return 0;
+}
+
+
+#ifdef __linux__
+// Returns the NUMA node of a CPU, or 0 on systems without NUMA topology
+static int cpu_node(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int node = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (sscanf(ent->d_name, "node%d", &node) == 1) {
+            break;
+        }
+    }
+
+    closedir(dir);
+    return node;
+}
+
+// Picks a peer CPU for the given placement relative to the current CPU
+static int pick_peer_cpu(int cpu, int placement) {
+    int cpus[MAX_THREADS];
+    int nr_cpus = get_cpus(cpus, MAX_THREADS);
+    int node = cpu_node(cpu);
+    int fallback = -1;
+
+    if (placement == IPC_SAME_CPU) {
+        return cpu;
+    }
+
+    for (int i = 0; i < nr_cpus; i++) {
+        if (cpus[i] == cpu) {
+            continue;
+        }
+
+        bool same_node = cpu_node(cpus[i]) == node;
+        if (placement == IPC_CROSS_NODE && !same_node) {
+            return cpus[i];
+        } else if (placement == IPC_CROSS_CPU) {
+            // Prefer a CPU on the same node so this stays distinct from the NUMA case
+            if (same_node)
+                return cpus[i];
+            if (fallback == -1)
+                fallback = cpus[i];
+        }
+    }
+
+    return fallback;
+}
+
+static long futex(atomic_int *addr, int op, int val) {
+    return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+static void *ipc_peer_main(void *arg) {
+    uint64_t val = 1;
+    char byte;
+
+    while (!atomic_load(&ipc.stop)) {
+        switch (ipc.kind) {
+        case IPC_PIPE:
+            if (read(ipc.ping_fds[0], &byte, 1) != 1 || write(ipc.pong_fds[1], &byte, 1) != 1)
+                return NULL;
+            break;
+        case IPC_EVENTFD:
+            if (read(ipc.ping_fds[0], &val, sizeof(val)) != sizeof(val) ||
+                    write(ipc.pong_fds[0], &val, sizeof(val)) != sizeof(val))
+                return NULL;
+            break;
+        case IPC_FUTEX: {
+            int state = atomic_load(&ipc.futex_word);
+            if (state != FUTEX_PING) {
+                futex(&ipc.futex_word, FUTEX_WAIT_PRIVATE, state);
+                continue;
+            }
+
+            atomic_store(&ipc.futex_word, FUTEX_PONG);
+            futex(&ipc.futex_word, FUTEX_WAKE_PRIVATE, 1);
+            break;
+        }
+        case IPC_YIELD:
+            sched_yield();
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// One round trip: wake the peer and wait for it to answer
+static void pipe_pingpong_mb(void) {
+    char byte = 0;
+    write(ipc.ping_fds[1], &byte, 1);
+    read(ipc.pong_fds[0], &byte, 1);
+}
+
+static void eventfd_pingpong_mb(void) {
+    uint64_t val = 1;
+    write(ipc.ping_fds[0], &val, sizeof(val));
+    read(ipc.pong_fds[0], &val, sizeof(val));
+}
+
+static void futex_pingpong_mb(void) {
+    atomic_store(&ipc.futex_word, FUTEX_PING);
+    futex(&ipc.futex_word, FUTEX_WAKE_PRIVATE, 1);
+
+    while (atomic_load(&ipc.futex_word) == FUTEX_PING) {
+        futex(&ipc.futex_word, FUTEX_WAIT_PRIVATE, FUTEX_PING);
+    }
+}
+
+// With the peer yielding on the same CPU, every call switches to it and back
+static void yield_mb(void) {
+    sched_yield();
+}
+
+// Closes whichever channel fds are open, skipping a pipe's write end if the peer's shutdown closed it
+static void ipc_close_fds(bool ping_closed) {
+    for (int i = 0; i < 2; i++) {
+        if (ipc.ping_fds[i] >= 0 && !(ping_closed && i == 1))
+            close(ipc.ping_fds[i]);
+        if (ipc.pong_fds[i] >= 0)
+            close(ipc.pong_fds[i]);
+        ipc.ping_fds[i] = ipc.pong_fds[i] = -1;
+    }
+}
+
+// Pins this thread where it is and starts a peer thread on a CPU chosen by placement
+static int ipc_setup(const struct bench_def *def) {
+    memset(&ipc, 0, sizeof(ipc));
+    ipc.kind = def->arg & IPC_KIND_MASK;
+    ipc.ping_fds[0] = ipc.ping_fds[1] = ipc.pong_fds[0] = ipc.pong_fds[1] = -1;
+
+    int cpu = sched_getcpu();
+    ipc.peer_cpu = pick_peer_cpu(cpu, def->arg & IPC_PLACEMENT_MASK);
+    if (ipc.peer_cpu < 0) {
+        return -1;
+    }
+
+    int ret = 0;
+    if (ipc.kind == IPC_PIPE) {
+        ret = pipe(ipc.ping_fds) || pipe(ipc.pong_fds);
+    } else if (ipc.kind == IPC_EVENTFD) {
+        ipc.ping_fds[0] = eventfd(0, 0);
+        ipc.pong_fds[0] = eventfd(0, 0);
+        ret = ipc.ping_fds[0] < 0 || ipc.pong_fds[0] < 0;
+    }
+
+    if (ret != 0) {
+        perror("failed to create IPC channel");
+        ipc_close_fds(0);
+        return -1;
+    }
+
+    sched_getaffinity(0, sizeof(ipc.saved_mask), &ipc.saved_mask);
+    pin_thread(cpu);
+
+    pthread_attr_t attr;
+    cpu_set_t peer_set;
+    CPU_ZERO(&peer_set);
+    CPU_SET(ipc.peer_cpu, &peer_set);
+    pthread_attr_init(&attr);
+    pthread_attr_setaffinity_np(&attr, sizeof(peer_set), &peer_set);
+
+    ret = pthread_create(&ipc.peer, &attr, ipc_peer_main, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        fprintf(stderr, "failed to create peer thread: %s\n", strerror(ret));
+        sched_setaffinity(0, sizeof(ipc.saved_mask), &ipc.saved_mask);
+        ipc_close_fds(0);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void ipc_teardown(const struct bench_def *def) {
+    uint64_t val = 1;
+
+    atomic_store(&ipc.stop, 1);
+    switch (ipc.kind) {
+    case IPC_PIPE:
+        close(ipc.ping_fds[1]);
+        break;
+    case IPC_EVENTFD:
+        write(ipc.ping_fds[0], &val, sizeof(val));
+        break;
+    case IPC_FUTEX:
+        atomic_store(&ipc.futex_word, FUTEX_PING);
+        futex(&ipc.futex_word, FUTEX_WAKE_PRIVATE, 1);
+        break;
+    }
+
+    pthread_join(ipc.peer, NULL);
+    ipc_close_fds(ipc.kind == IPC_PIPE);
+
+    sched_setaffinity(0, sizeof(ipc.saved_mask), &ipc.saved_mask);
+}
+#else
+#define pipe_pingpong_mb NULL
+#define eventfd_pingpong_mb NULL
+#define futex_pingpong_mb NULL
+#define yield_mb NULL
+#define ipc_setup NULL
+#define ipc_teardown NULL
+#endif
+
+static void sample_buf_free(struct sample_buf *samples) {
+    free(samples->ns);
+    samples->ns = NULL;
+}
+
+// Grows the buffer if needed, which only happens when --adaptive doesn't know the round count
+static void sample_add(struct sample_buf *samples, double ns) {
+    if (samples->len == samples->cap) {
+        long cap = samples->cap ? samples->cap * 2 : 64;
+        double *buf = realloc(samples->ns, cap * sizeof(*buf));
+        if (buf == NULL) {
+            return;
+        }
+
+        samples->ns = buf;
+        samples->cap = cap;
+    }
+
+    samples->ns[samples->len++] = ns;
+}
+
+static pthread_mutex_t handoff_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sample_buf handoff_samples;
+
+#ifdef __linux__
+static pthread_mutex_t sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t sync_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_spinlock_t sync_spinlock;
+static pthread_once_t sync_spinlock_once = PTHREAD_ONCE_INIT;
+static atomic_int sync_futex __attribute__((aligned(CACHE_LINE_SIZE)));
+static atomic_long sync_counter __attribute__((aligned(CACHE_LINE_SIZE)));
+// One counter per thread, all in the same cache line
+static atomic_long sync_false_shared[CACHE_LINE_SIZE / sizeof(atomic_long)] __attribute__((aligned(CACHE_LINE_SIZE)));
+static atomic_int sync_next_id;
+
+// Written by the lock holder, so the next holder can tell how long the lock took to reach it
+static int sync_owner;
+static uint64_t sync_release_ts;
+
+static __thread int sync_self;
+static __thread struct {
+    atomic_long val;
+} __attribute__((aligned(CACHE_LINE_SIZE))) sync_padded;
+static __thread struct sample_buf handoff_local;
+
+static void init_sync_spinlock(void) {
+    pthread_spin_init(&sync_spinlock, PTHREAD_PROCESS_PRIVATE);
+}
+
+static void handoff_acquired(void) {
+    if (sync_owner != 0 && sync_owner != sync_self && handoff_local.len < HANDOFF_MAX_SAMPLES) {
+        sample_add(&handoff_local, timer_elapsed_ns(sync_release_ts, timer_end()));
+    }
+}
+
+static void handoff_release(void) {
+    sync_owner = sync_self;
+    sync_release_ts = timer_begin();
+}
+
+// Drepper's three-state futex mutex: 0 unlocked, 1 locked, 2 locked with waiters
+static void futex_mutex_lock(void) {
+    int c = 0;
+    if (atomic_compare_exchange_strong(&sync_futex, &c, 1)) {
+        return;
+    }
+
+    if (c != 2) {
+        c = atomic_exchange(&sync_futex, 2);
+    }
+    while (c != 0) {
+        futex(&sync_futex, FUTEX_WAIT_PRIVATE, 2);
+        c = atomic_exchange(&sync_futex, 2);
+    }
+}
+
+static void futex_mutex_unlock(void) {
+    if (atomic_exchange(&sync_futex, 0) == 2) {
+        futex(&sync_futex, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+static void mutex_mb(void) {
+    pthread_mutex_lock(&sync_mutex);
+    pthread_mutex_unlock(&sync_mutex);
+}
+DEFINE_INLINE_LOOPS(mutex_mb);
+
+static void mutex_handoff_mb(void) {
+    pthread_mutex_lock(&sync_mutex);
+    handoff_acquired();
+    handoff_release();
+    pthread_mutex_unlock(&sync_mutex);
+}
+
+static void rwlock_read_mb(void) {
+    pthread_rwlock_rdlock(&sync_rwlock);
+    pthread_rwlock_unlock(&sync_rwlock);
+}
+DEFINE_INLINE_LOOPS(rwlock_read_mb);
+
+static void rwlock_write_mb(void) {
+    pthread_rwlock_wrlock(&sync_rwlock);
+    pthread_rwlock_unlock(&sync_rwlock);
+}
+DEFINE_INLINE_LOOPS(rwlock_write_mb);
+
+static void spinlock_mb(void) {
+    pthread_spin_lock(&sync_spinlock);
+    pthread_spin_unlock(&sync_spinlock);
+}
+DEFINE_INLINE_LOOPS(spinlock_mb);
+
+static void spinlock_handoff_mb(void) {
+    pthread_spin_lock(&sync_spinlock);
+    handoff_acquired();
+    handoff_release();
+    pthread_spin_unlock(&sync_spinlock);
+}
+
+static void futex_lock_mb(void) {
+    futex_mutex_lock();
+    futex_mutex_unlock();
+}
+DEFINE_INLINE_LOOPS(futex_lock_mb);
+
+static void futex_lock_handoff_mb(void) {
+    futex_mutex_lock();
+    handoff_acquired();
+    handoff_release();
+    futex_mutex_unlock();
+}
+
+// No waiters, so this is just the syscall and a futex hash bucket lookup
+static void futex_wake_mb(void) {
+    futex(&sync_futex, FUTEX_WAKE_PRIVATE, 1);
+}
+DEFINE_INLINE_LOOPS(futex_wake_mb);
+
+static void atomic_shared_mb(void) {
+    atomic_fetch_add(&sync_counter, 1);
+}
+DEFINE_INLINE_LOOPS(atomic_shared_mb);
+
+static void atomic_false_shared_mb(void) {
+    atomic_fetch_add(&sync_false_shared[sync_self % ARRAY_SIZE(sync_false_shared)], 1);
+}
+DEFINE_INLINE_LOOPS(atomic_false_shared_mb);
+
+static void atomic_padded_mb(void) {
+    atomic_fetch_add(&sync_padded.val, 1);
+}
+DEFINE_INLINE_LOOPS(atomic_padded_mb);
+
+#if defined(__NR_futex_waitv) && defined(FUTEX_32)
+static __thread struct futex_waitv sync_waiters[SYNC_WAITV_LEN];
+static __thread uint32_t sync_waitv_words[SYNC_WAITV_LEN];
+
+// Fails with EAGAIN without sleeping because none of the values match
+static void futex_waitv_mb(void) {
+    syscall(__NR_futex_waitv, sync_waiters, SYNC_WAITV_LEN, 0, NULL, CLOCK_MONOTONIC);
+}
+
+static int futex_waitv_setup(const struct bench_def *def) {
+    for (int i = 0; i < SYNC_WAITV_LEN; i++) {
+        sync_waiters[i] = (struct futex_waitv) {
+            .val = 1,
+            .uaddr = (uintptr_t) &sync_waitv_words[i],
+            .flags = FUTEX_32 | FUTEX_PRIVATE_FLAG,
+        };
+    }
+
+    if (syscall(__NR_futex_waitv, sync_waiters, 1, 0, NULL, CLOCK_MONOTONIC) == -1 && errno == ENOSYS) {
+        return 1;
+    }
+
+    return 0;
+}
+#else
+#define futex_waitv_mb NULL
+#define futex_waitv_setup NULL
+#endif
+
+static int sync_setup(const struct bench_def *def) {
+    pthread_once(&sync_spinlock_once, init_sync_spinlock);
+    sync_self = atomic_fetch_add(&sync_next_id, 1) + 1;
+    return 0;
+}
+
+// Pools this thread's handoffs with those of the others for bench_scaling to report
+static void sync_teardown(const struct bench_def *def) {
+    pthread_mutex_lock(&handoff_lock);
+    for (long i = 0; i < handoff_local.len; i++) {
+        sample_add(&handoff_samples, handoff_local.ns[i]);
+    }
+    pthread_mutex_unlock(&handoff_lock);
+
+    sample_buf_free(&handoff_local);
+    handoff_local = (struct sample_buf) { 0 };
+    sync_owner = 0;
+}
+#else
+#define mutex_mb NULL
+#define mutex_mb_inline NULL
+#define mutex_handoff_mb NULL
+#define rwlock_read_mb NULL
+#define rwlock_read_mb_inline NULL
+#define rwlock_write_mb NULL
+#define rwlock_write_mb_inline NULL
+#define spinlock_mb NULL
+#define spinlock_mb_inline NULL
+#define spinlock_handoff_mb NULL
+#define futex_lock_mb NULL
+#define futex_lock_mb_inline NULL
+#define futex_lock_handoff_mb NULL
+#define futex_wake_mb NULL
+#define futex_wake_mb_inline NULL
+#define futex_waitv_mb NULL
+#define atomic_shared_mb NULL
+#define atomic_shared_mb_inline NULL
+#define atomic_false_shared_mb NULL
+#define atomic_false_shared_mb_inline NULL
+#define atomic_padded_mb NULL
+#define atomic_padded_mb_inline NULL
+#define futex_waitv_setup NULL
+#define sync_setup NULL
+#define sync_teardown NULL
+#endif
+
+static const struct bench_group bench_groups[] = {
+    {"time", "clock_gettime"},
+    {"entry", "syscall entry"},
+    {"file", "read file"},
+    {"uring", "io_uring"},
+    {"mem", "memory mapping"},
+    {"bw", "memory bandwidth"},
+    {"storage", "storage"},
+    {"net", "socket"},
+    {"ipc", "context switch round trip"},
+    {"proc", "process lifecycle"},
+    {"sync", "synchronization"},
+};
+
+static const struct bench_def benchmarks[] = {
+    {
+        .name = "syscall",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_MONOTONIC) via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_syscall_mb,
+        .inlined = time_syscall_mb_inline,
+        .arg = CLOCK_MONOTONIC,
+    },
+    {
+        .name = "getpid",
+        .group = "time",
+        .desc = "getpid via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = getpid_syscall_mb,
+        .inlined = getpid_syscall_mb_inline,
+    },
+    {
+        .name = "libc",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_MONOTONIC) via libc (vDSO on Linux)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_libc_mb,
+        .inlined = time_libc_mb_inline,
+        .arg = CLOCK_MONOTONIC,
+        .syscall_ref = "syscall",
+    },
+#ifdef CLOCK_REALTIME
+    {
+        .name = "realtime_syscall",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_REALTIME) via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_syscall_mb,
+        .inlined = time_syscall_mb_inline,
+        .arg = CLOCK_REALTIME,
+    },
+    {
+        .name = "realtime_libc",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_REALTIME) via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_libc_mb,
+        .inlined = time_libc_mb_inline,
+        .arg = CLOCK_REALTIME,
+        .syscall_ref = "realtime_syscall",
+    },
+#endif
+#ifdef CLOCK_MONOTONIC_RAW
+    {
+        .name = "monotonic_raw_syscall",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_MONOTONIC_RAW) via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_syscall_mb,
+        .inlined = time_syscall_mb_inline,
+        .arg = CLOCK_MONOTONIC_RAW,
+    },
+    {
+        .name = "monotonic_raw_libc",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_MONOTONIC_RAW) via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_libc_mb,
+        .inlined = time_libc_mb_inline,
+        .arg = CLOCK_MONOTONIC_RAW,
+        .syscall_ref = "monotonic_raw_syscall",
+    },
+#endif
+#ifdef CLOCK_BOOTTIME
+    {
+        .name = "boottime_syscall",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_BOOTTIME) via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_syscall_mb,
+        .inlined = time_syscall_mb_inline,
+        .arg = CLOCK_BOOTTIME,
+    },
+    {
+        .name = "boottime_libc",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_BOOTTIME) via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_libc_mb,
+        .inlined = time_libc_mb_inline,
+        .arg = CLOCK_BOOTTIME,
+        .syscall_ref = "boottime_syscall",
+    },
+#endif
+#ifdef CLOCK_REALTIME_COARSE
+    {
+        .name = "realtime_coarse_syscall",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_REALTIME_COARSE) via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_syscall_mb,
+        .inlined = time_syscall_mb_inline,
+        .arg = CLOCK_REALTIME_COARSE,
+    },
+    {
+        .name = "realtime_coarse_libc",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_REALTIME_COARSE) via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_libc_mb,
+        .inlined = time_libc_mb_inline,
+        .arg = CLOCK_REALTIME_COARSE,
+        .syscall_ref = "realtime_coarse_syscall",
+    },
+#endif
+#ifdef CLOCK_MONOTONIC_COARSE
+    {
+        .name = "monotonic_coarse_syscall",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_MONOTONIC_COARSE) via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_syscall_mb,
+        .inlined = time_syscall_mb_inline,
+        .arg = CLOCK_MONOTONIC_COARSE,
+    },
+    {
+        .name = "monotonic_coarse_libc",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_MONOTONIC_COARSE) via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_libc_mb,
+        .inlined = time_libc_mb_inline,
+        .arg = CLOCK_MONOTONIC_COARSE,
+        .syscall_ref = "monotonic_coarse_syscall",
+    },
+#endif
+#ifdef CLOCK_TAI
+    {
+        .name = "tai_syscall",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_TAI) via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_syscall_mb,
+        .inlined = time_syscall_mb_inline,
+        .arg = CLOCK_TAI,
+    },
+    {
+        .name = "tai_libc",
+        .group = "time",
+        .desc = "clock_gettime(CLOCK_TAI) via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = time_libc_mb,
+        .inlined = time_libc_mb_inline,
+        .arg = CLOCK_TAI,
+        .syscall_ref = "tai_syscall",
+    },
+#endif
+    {
+        .name = "getres_syscall",
+        .group = "time",
+        .desc = "clock_getres(CLOCK_MONOTONIC) via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = getres_syscall_mb,
+        .inlined = getres_syscall_mb_inline,
+        .arg = CLOCK_MONOTONIC,
+    },
+    {
+        .name = "getres_libc",
+        .group = "time",
+        .desc = "clock_getres(CLOCK_MONOTONIC) via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = clock_setup,
+        .impl = getres_libc_mb,
+        .inlined = getres_libc_mb_inline,
+        .arg = CLOCK_MONOTONIC,
+        .syscall_ref = "getres_syscall",
+    },
+    {
+        .name = "gettimeofday_syscall",
+        .group = "time",
+        .desc = "gettimeofday via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = gettimeofday_syscall_mb,
+        .inlined = gettimeofday_syscall_mb_inline,
+    },
+    {
+        .name = "gettimeofday_libc",
+        .group = "time",
+        .desc = "gettimeofday via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = gettimeofday_libc_mb,
+        .inlined = gettimeofday_libc_mb_inline,
+        .syscall_ref = "gettimeofday_syscall",
+    },
+    {
+        .name = "time_syscall",
+        .group = "time",
+        .desc = "time via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = time_t_syscall_mb,
+        .inlined = time_t_syscall_mb_inline,
+    },
+    {
+        .name = "time_libc",
+        .group = "time",
+        .desc = "time via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = time_t_libc_mb,
+        .inlined = time_t_libc_mb_inline,
+        .syscall_ref = "time_syscall",
+    },
+    {
+        .name = "getcpu_syscall",
+        .group = "time",
+        .desc = "getcpu via syscall(2)",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = getcpu_syscall_mb,
+        .inlined = getcpu_syscall_mb_inline,
+    },
+    {
+        .name = "getcpu_libc",
+        .group = "time",
+        .desc = "getcpu via libc",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = getcpu_libc_mb,
+        .inlined = getcpu_libc_mb_inline,
+        .syscall_ref = "getcpu_syscall",
+    },
+    {
+        .name = "getpid_asm",
+        .group = "entry",
+        .desc = "getpid via an inline syscall or svc #0 instruction",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = getpid_asm_mb,
+        .inlined = getpid_asm_mb_inline,
+    },
+    {
+        .name = "nosys_asm",
+        .group = "entry",
+        .desc = "syscall number -1, which only enters and exits the kernel",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .impl = nosys_asm_mb,
+        .inlined = nosys_asm_mb_inline,
+    },
+    {
+        .name = "int80",
+        .group = "entry",
+        .desc = "getpid via int 0x80, the 32-bit compat entry path on x86_64",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = int80_setup,
+        .impl = int80_mb,
+        .inlined = int80_mb_inline,
+    },
+    {
+        .name = "seccomp",
+        .group = "entry",
+        .desc = "getpid_asm on a thread with a --seccomp-len syscall number filter",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = seccomp_setup,
+        .impl = getpid_asm_mb,
+        .inlined = getpid_asm_mb_inline,
+        .flags = BENCH_ISOLATED | BENCH_NO_THREADS,
+    },
+    {
+        .name = "seccomp_args",
+        .group = "entry",
+        .desc = "getpid_asm on a thread with a --seccomp-len argument filter the kernel can't cache",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = seccomp_setup,
+        .impl = getpid_asm_mb,
+        .inlined = getpid_asm_mb_inline,
+        .arg = SECCOMP_CHECK_ARGS,
+        .flags = BENCH_ISOLATED | BENCH_NO_THREADS,
+    },
+    {
+        .name = "mmap",
+        .group = "file",
+        .desc = "open, mmap, copy --size bytes of --path, munmap and close",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = mmap_path_setup,
+        .impl = mmap_mb,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "read",
+        .group = "file",
+        .desc = "open, read --size bytes of --path and close",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = path_setup,
+        .impl = file_mb,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "pread",
+        .group = "file",
+        .desc = "pread --size bytes from an fd opened in setup",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = open_setup,
+        .teardown = open_teardown,
+        .impl = pread_mb,
+        .inlined = pread_mb_inline,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "read_write",
+        .group = "file",
+        .desc = "pread --size bytes of --path and write them to /dev/null",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = zc_setup,
+        .teardown = zc_teardown,
+        .impl = read_write_mb,
+        .arg = ZC_READ_WRITE,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "sendfile",
+        .group = "file",
+        .desc = "sendfile(2) --size bytes of --path to /dev/null",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = zc_setup,
+        .teardown = zc_teardown,
+        .impl = sendfile_mb,
+        .arg = ZC_SENDFILE,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "splice",
+        .group = "file",
+        .desc = "splice(2) --size bytes of --path through a pipe to /dev/null",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = zc_setup,
+        .teardown = zc_teardown,
+        .impl = splice_mb,
+        .arg = ZC_SPLICE,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "vmsplice",
+        .group = "file",
+        .desc = "vmsplice(2) --size bytes of a user buffer into a pipe and splice it to /dev/null",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = zc_setup,
+        .teardown = zc_teardown,
+        .impl = vmsplice_mb,
+        .arg = ZC_VMSPLICE,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "copy_file_range",
+        .group = "file",
+        .desc = "copy_file_range(2) --size bytes of --path to a file on the same filesystem",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = zc_setup,
+        .teardown = zc_teardown,
+        .impl = copy_file_range_mb,
+        .arg = ZC_COPY_FILE_RANGE,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "mmap_touch",
+        .group = "file",
+        .desc = "mmap --size bytes of an fd opened in setup, fault in every page and munmap",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = open_mmap_setup,
+        .teardown = open_teardown,
+        .impl = mmap_touch_mb,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "memcpy",
+        .group = "file",
+        .desc = "copy --size bytes from a region mapped and faulted in during setup",
+        .calls = 100,
+        .loops = 128,
+        .rounds = 5,
+        .setup = map_setup,
+        .teardown = map_teardown,
+        .impl = memcpy_mb,
+        .inlined = memcpy_mb_inline,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "pread",
+        .group = "uring",
+        .desc = "baseline: one pread(2) of --size bytes per operation",
+        .calls = 1024,
+        .loops = 32,
+        .rounds = 5,
+        .setup = open_setup,
+        .teardown = open_teardown,
+        .impl = pread_mb,
+        .inlined = pread_mb_inline,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "nop",
+        .group = "uring",
+        .desc = "submit --batch NOPs with one io_uring_enter(2) and wait for them",
+        .calls = 1024,
+        .loops = 32,
+        .rounds = 5,
+        .setup = uring_setup,
+        .teardown = uring_teardown,
+        .impl = uring_mb,
+        .flags = BENCH_BATCHED,
+    },
+    {
+        .name = "read",
+        .group = "uring",
+        .desc = "submit --batch reads of --size bytes from --path with one io_uring_enter(2) and wait for them",
+        .calls = 1024,
+        .loops = 32,
+        .rounds = 5,
+        .setup = uring_setup,
+        .teardown = uring_teardown,
+        .impl = uring_mb,
+        .arg = URING_READ,
+        .flags = BENCH_SIZED | BENCH_BATCHED,
+    },
+    {
+        .name = "nop_sqpoll",
+        .group = "uring",
+        .desc = "submit --batch NOPs to an SQPOLL ring without syscalls and poll for completions",
+        .calls = 1024,
+        .loops = 32,
+        .rounds = 5,
+        .setup = uring_setup,
+        .teardown = uring_teardown,
+        .impl = uring_mb,
+        .arg = URING_SQPOLL,
+        .flags = BENCH_BATCHED,
+    },
+    {
+        .name = "read_sqpoll",
+        .group = "uring",
+        .desc = "submit --batch reads of --size bytes to an SQPOLL ring and poll for completions",
+        .calls = 1024,
+        .loops = 32,
+        .rounds = 5,
+        .setup = uring_setup,
+        .teardown = uring_teardown,
+        .impl = uring_mb,
+        .arg = URING_READ | URING_SQPOLL,
+        .flags = BENCH_SIZED | BENCH_BATCHED,
+    },
+    {
+        .name = "mmap",
+        .group = "mem",
+        .desc = "mmap and munmap --size bytes of anonymous memory without touching it",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .impl = anon_mmap_mb,
+        .flags = BENCH_SIZED | BENCH_PAGED,
+    },
+    {
+        .name = "fault",
+        .group = "mem",
+        .desc = "mmap --size bytes of anonymous memory, write to every page and munmap",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .impl = anon_fault_mb,
+        .flags = BENCH_SIZED | BENCH_PAGED,
+    },
+    {
+        .name = "populate",
+        .group = "mem",
+        .desc = "mmap --size bytes of anonymous memory with MAP_POPULATE and munmap",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .impl = anon_populate_mb,
+        .flags = BENCH_SIZED | BENCH_PAGED,
+    },
+    {
+        .name = "thp_fault",
+        .group = "mem",
+        .desc = "like fault, with MADV_HUGEPAGE on a 2 MiB aligned region (--size must be a multiple of 2M)",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = thp_setup,
+        .impl = thp_fault_mb,
+        .flags = BENCH_SIZED | BENCH_PAGED,
+    },
+    {
+        .name = "dontneed",
+        .group = "mem",
+        .desc = "madvise(MADV_DONTNEED) --size bytes of populated memory and write to every page again",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = anon_map_setup,
+        .teardown = anon_map_teardown,
+        .impl = dontneed_fault_mb,
+        .flags = BENCH_SIZED | BENCH_PAGED,
+    },
+    {
+        .name = "mprotect",
+        .group = "mem",
+        .desc = "mprotect --size bytes of populated memory, alternating read-only and read-write",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = anon_map_setup,
+        .teardown = anon_map_teardown,
+        .impl = mprotect_mb,
+        .flags = BENCH_SIZED | BENCH_PAGED,
+    },
+    {
+        .name = "socketpair",
+        .group = "net",
+        .desc = "write and read 64 bytes on an AF_UNIX stream socketpair(2)",
+        .calls = 10000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = net_setup,
+        .teardown = net_teardown,
+        .impl = socket_mb,
+        .arg = NET_UNIX,
+    },
+    {
+        .name = "udp",
+        .group = "net",
+        .desc = "sendto and recvfrom a 64-byte datagram over loopback",
+        .calls = 10000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = net_setup,
+        .teardown = net_teardown,
+        .impl = udp_mb,
+        .arg = NET_UDP,
+    },
+    {
+        .name = "udp_mmsg",
+        .group = "net",
+        .desc = "sendmmsg and recvmmsg --batch 64-byte datagrams over loopback",
+        .calls = 10000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = net_setup,
+        .teardown = net_teardown,
+        .impl = udp_mmsg_mb,
+        .arg = NET_UDP_MMSG,
+        .flags = BENCH_BATCHED,
+    },
+    {
+        .name = "tcp_rr",
+        .group = "net",
+        .desc = "64-byte request and response over a loopback TCP connection",
+        .calls = 10000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = net_setup,
+        .teardown = net_teardown,
+        .impl = tcp_rr_mb,
+        .arg = NET_TCP,
+    },
+    {
+        .name = "tcp_stream",
+        .group = "net",
+        .desc = "send and receive --size bytes over a loopback TCP connection",
+        .calls = 100,
+        .loops = 32,
+        .rounds = 5,
+        .setup = net_setup,
+        .teardown = net_teardown,
+        .impl = tcp_stream_mb,
+        .arg = NET_TCP,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "tcp_zerocopy",
+        .group = "net",
+        .desc = "like tcp_stream with MSG_ZEROCOPY sends, reaping completion notifications",
+        .calls = 100,
+        .loops = 32,
+        .rounds = 5,
+        .setup = net_setup,
+        .teardown = net_teardown,
+        .impl = tcp_zerocopy_mb,
+        .arg = NET_TCP_ZEROCOPY,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "epoll_wait",
+        .group = "net",
+        .desc = "epoll_wait(2) with a zero timeout on one idle socket",
+        .calls = 100000,
+        .loops = 32,
+        .rounds = 5,
+        .setup = net_setup,
+        .teardown = net_teardown,
+        .impl = epoll_mb,
+        .inlined = epoll_mb_inline,
+        .arg = NET_EPOLL,
+    },
+    {
+        .name = "memcpy",
+        .group = "bw",
+        .desc = "libc memcpy of --size bytes",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = bw_memcpy_mb,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "memset",
+        .group = "bw",
+        .desc = "libc memset of --size bytes",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = bw_memset_mb,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "copy_sse2",
+        .group = "bw",
+        .desc = "copy --size bytes with SSE2 loads and stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = copy_sse2_mb,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "copy_avx2",
+        .group = "bw",
+        .desc = "copy --size bytes with AVX2 loads and stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = copy_avx2_mb,
+        .arg = BW_AVX2,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "copy_avx512",
+        .group = "bw",
+        .desc = "copy --size bytes with AVX-512 loads and stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = copy_avx512_mb,
+        .arg = BW_AVX512,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "copy_neon",
+        .group = "bw",
+        .desc = "copy --size bytes with NEON loads and stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = copy_neon_mb,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "stream_sse2",
+        .group = "bw",
+        .desc = "copy --size bytes with SSE2 non-temporal stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = stream_sse2_mb,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "stream_avx2",
+        .group = "bw",
+        .desc = "copy --size bytes with AVX2 non-temporal stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = stream_avx2_mb,
+        .arg = BW_AVX2,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "stream_avx512",
+        .group = "bw",
+        .desc = "copy --size bytes with AVX-512 non-temporal stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = stream_avx512_mb,
+        .arg = BW_AVX512,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "stream_neon",
+        .group = "bw",
+        .desc = "copy --size bytes with STNP non-temporal stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = stream_neon_mb,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "stream_set_sse2",
+        .group = "bw",
+        .desc = "fill --size bytes with SSE2 non-temporal stores",
+        .calls = 1000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = bw_setup,
+        .teardown = bw_teardown,
+        .impl = stream_set_sse2_mb,
+        .flags = BENCH_SIZED | BENCH_CACHE_SWEEP,
+    },
+    {
+        .name = "cold_read",
+        .group = "storage",
+        .desc = "drop a random --size range of --storage from the page cache and pread it",
+        .calls = 16,
+        .loops = 16,
+        .rounds = 3,
+        .setup = storage_setup,
+        .teardown = storage_teardown,
+        .impl = cold_read_mb,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "readahead",
+        .group = "storage",
+        .desc = "like cold_read with readahead(2) on the range before reading it",
+        .calls = 16,
+        .loops = 16,
+        .rounds = 3,
+        .setup = storage_setup,
+        .teardown = storage_teardown,
+        .impl = readahead_read_mb,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "mmap_cold",
+        .group = "storage",
+        .desc = "drop a random range, mmap it and read every page",
+        .calls = 16,
+        .loops = 16,
+        .rounds = 3,
+        .setup = storage_setup,
+        .teardown = storage_teardown,
+        .impl = mmap_cold_mb,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "mmap_willneed",
+        .group = "storage",
+        .desc = "like mmap_cold with madvise(MADV_WILLNEED) before reading",
+        .calls = 16,
+        .loops = 16,
+        .rounds = 3,
+        .setup = storage_setup,
+        .teardown = storage_teardown,
+        .impl = mmap_willneed_mb,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "nowait_miss",
+        .group = "storage",
+        .desc = "drop a random range and try preadv2(RWF_NOWAIT), which fails with EAGAIN",
+        .calls = 16,
+        .loops = 16,
+        .rounds = 3,
+        .setup = storage_setup,
+        .teardown = storage_teardown,
+        .impl = nowait_miss_mb,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "direct",
+        .group = "storage",
+        .desc = "O_DIRECT pread of a random --size block",
+        .calls = 16,
+        .loops = 16,
+        .rounds = 3,
+        .setup = storage_setup,
+        .teardown = storage_teardown,
+        .impl = direct_read_mb,
+        .arg = STORAGE_DIRECT,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "direct_hipri",
+        .group = "storage",
+        .desc = "O_DIRECT preadv2(RWF_HIPRI), polling on devices with poll queues",
+        .calls = 16,
+        .loops = 16,
+        .rounds = 3,
+        .setup = storage_setup,
+        .teardown = storage_teardown,
+        .impl = hipri_read_mb,
+        .arg = STORAGE_DIRECT,
+        .flags = BENCH_SIZED,
+    },
+    {
+        .name = "direct_qd",
+        .group = "storage",
+        .desc = "O_DIRECT io_uring reads of random blocks, --batch at a time for the queue depth",
+        .calls = 16,
+        .loops = 16,
+        .rounds = 3,
+        .setup = storage_setup,
+        .teardown = storage_teardown,
+        .impl = direct_uring_mb,
+        .arg = STORAGE_DIRECT,
+        .flags = BENCH_SIZED | BENCH_BATCHED,
+    },
+    {
+        .name = "fork",
+        .group = "proc",
+        .desc = "fork(2) a child that exits immediately and wait for it",
+        .calls = 20,
+        .loops = 16,
+        .rounds = 3,
+        .impl = fork_mb,
+    },
+    {
+        .name = "vfork",
+        .group = "proc",
+        .desc = "vfork(2) a child that exits immediately and wait for it",
+        .calls = 20,
+        .loops = 16,
+        .rounds = 3,
+        .impl = vfork_mb,
+    },
+    {
+        .name = "clone3_vm",
+        .group = "proc",
+        .desc = "clone3(2) with CLONE_VM, sharing memory with a child that exits immediately",
+        .calls = 20,
+        .loops = 16,
+        .rounds = 3,
+        .setup = clone3_setup,
+        .impl = clone3_vm_mb,
+    },
+    {
+        .name = "pthread_create",
+        .group = "proc",
+        .desc = "pthread_create(3) an empty thread and join it",
+        .calls = 20,
+        .loops = 16,
+        .rounds = 3,
+        .impl = pthread_create_mb,
+    },
+    {
+        .name = "posix_spawn",
+        .group = "proc",
+        .desc = "posix_spawn(3) the --exec program and wait for it",
+        .calls = 20,
+        .loops = 16,
+        .rounds = 3,
+        .setup = exec_setup,
+        .impl = posix_spawn_mb,
+    },
+    {
+        .name = "fork_exec",
+        .group = "proc",
+        .desc = "fork(2) and execve(2) the --exec program and wait for it",
+        .calls = 20,
+        .loops = 16,
+        .rounds = 3,
+        .setup = exec_setup,
+        .impl = fork_exec_mb,
+    },
+    {
+        .name = "mutex",
+        .group = "sync",
+        .desc = "lock and unlock a pthread mutex shared by all threads",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = mutex_mb,
+        .inlined = mutex_mb_inline,
+    },
+    {
+        .name = "mutex_handoff",
+        .group = "sync",
+        .desc = "mutex with timestamps to measure handoffs between threads",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = mutex_handoff_mb,
+        .flags = BENCH_HANDOFF,
+    },
+    {
+        .name = "rwlock_read",
+        .group = "sync",
+        .desc = "read-lock and unlock a pthread rwlock shared by all threads",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = rwlock_read_mb,
+        .inlined = rwlock_read_mb_inline,
+    },
+    {
+        .name = "rwlock_write",
+        .group = "sync",
+        .desc = "write-lock and unlock a pthread rwlock shared by all threads",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = rwlock_write_mb,
+        .inlined = rwlock_write_mb_inline,
+    },
+    {
+        .name = "spinlock",
+        .group = "sync",
+        .desc = "lock and unlock a pthread spinlock shared by all threads",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = spinlock_mb,
+        .inlined = spinlock_mb_inline,
+    },
+    {
+        .name = "spinlock_handoff",
+        .group = "sync",
+        .desc = "spinlock with timestamps to measure handoffs between threads",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = spinlock_handoff_mb,
+        .flags = BENCH_HANDOFF,
+    },
+    {
+        .name = "futex_lock",
+        .group = "sync",
+        .desc = "lock and unlock a mutex built on FUTEX_WAIT and FUTEX_WAKE",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = futex_lock_mb,
+        .inlined = futex_lock_mb_inline,
+    },
+    {
+        .name = "futex_lock_handoff",
+        .group = "sync",
+        .desc = "futex_lock with timestamps to measure handoffs between threads",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = futex_lock_handoff_mb,
+        .flags = BENCH_HANDOFF,
+    },
+    {
+        .name = "futex_wake",
+        .group = "sync",
+        .desc = "FUTEX_WAKE on a futex with no waiters",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = futex_wake_mb,
+        .inlined = futex_wake_mb_inline,
+    },
+    {
+        .name = "futex_waitv",
+        .group = "sync",
+        .desc = "futex_waitv(2) on 8 futexes whose values don't match",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = futex_waitv_setup,
+        .impl = futex_waitv_mb,
+    },
+    {
+        .name = "atomic_shared",
+        .group = "sync",
+        .desc = "atomic fetch-add on one counter shared by all threads",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = atomic_shared_mb,
+        .inlined = atomic_shared_mb_inline,
+    },
+    {
+        .name = "atomic_false_shared",
+        .group = "sync",
+        .desc = "atomic fetch-add on per-thread counters in the same cache line",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = atomic_false_shared_mb,
+        .inlined = atomic_false_shared_mb_inline,
+    },
+    {
+        .name = "atomic_padded",
+        .group = "sync",
+        .desc = "atomic fetch-add on per-thread counters in separate cache lines",
+        .calls = 100000,
+        .loops = 16,
+        .rounds = 3,
+        .setup = sync_setup,
+        .teardown = sync_teardown,
+        .impl = atomic_padded_mb,
+        .inlined = atomic_padded_mb_inline,
+    },
+    {
+        .name = "pipe_same",
+        .group = "ipc",
+        .desc = "a 1-byte pipe(2) round trip with a peer thread on the same CPU",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = pipe_pingpong_mb,
+        .arg = IPC_PIPE | IPC_SAME_CPU,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "pipe_cross",
+        .group = "ipc",
+        .desc = "a 1-byte pipe(2) round trip with a peer thread on another CPU",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = pipe_pingpong_mb,
+        .arg = IPC_PIPE | IPC_CROSS_CPU,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "pipe_numa",
+        .group = "ipc",
+        .desc = "a 1-byte pipe(2) round trip with a peer thread on another NUMA node",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = pipe_pingpong_mb,
+        .arg = IPC_PIPE | IPC_CROSS_NODE,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "eventfd_same",
+        .group = "ipc",
+        .desc = "an eventfd(2) round trip with a peer thread on the same CPU",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = eventfd_pingpong_mb,
+        .arg = IPC_EVENTFD | IPC_SAME_CPU,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "eventfd_cross",
+        .group = "ipc",
+        .desc = "an eventfd(2) round trip with a peer thread on another CPU",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = eventfd_pingpong_mb,
+        .arg = IPC_EVENTFD | IPC_CROSS_CPU,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "eventfd_numa",
+        .group = "ipc",
+        .desc = "an eventfd(2) round trip with a peer thread on another NUMA node",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = eventfd_pingpong_mb,
+        .arg = IPC_EVENTFD | IPC_CROSS_NODE,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "futex_same",
+        .group = "ipc",
+        .desc = "a FUTEX_WAKE/FUTEX_WAIT round trip with a peer thread on the same CPU",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = futex_pingpong_mb,
+        .arg = IPC_FUTEX | IPC_SAME_CPU,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "futex_cross",
+        .group = "ipc",
+        .desc = "a FUTEX_WAKE/FUTEX_WAIT round trip with a peer thread on another CPU",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = futex_pingpong_mb,
+        .arg = IPC_FUTEX | IPC_CROSS_CPU,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "futex_numa",
+        .group = "ipc",
+        .desc = "a FUTEX_WAKE/FUTEX_WAIT round trip with a peer thread on another NUMA node",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = futex_pingpong_mb,
+        .arg = IPC_FUTEX | IPC_CROSS_NODE,
+        .flags = BENCH_NO_THREADS,
+    },
+    {
+        .name = "yield",
+        .group = "ipc",
+        .desc = "sched_yield(2) to a peer thread yielding on the same CPU",
+        .calls = 10000,
+        .loops = 16,
+        .rounds = 5,
+        .setup = ipc_setup,
+        .teardown = ipc_teardown,
+        .impl = yield_mb,
+        .arg = IPC_YIELD | IPC_SAME_CPU,
+        .flags = BENCH_NO_THREADS,
+    },
+};
+
+#define NR_BENCH_GROUPS ARRAY_SIZE(bench_groups)
+#define NR_BENCHMARKS ARRAY_SIZE(benchmarks)
+
+static bool selected[NR_BENCHMARKS];
+
+static int sample_buf_init(struct sample_buf *samples, long cap, bool per_call) {
+    samples->ns = malloc(cap * sizeof(*samples->ns));
+    samples->len = 0;
+    samples->cap = samples->ns != NULL ? cap : 0;
+    samples->per_call = per_call;
+
+    if (samples->ns == NULL) {
+        fprintf(stderr, "failed to allocate %ld samples\n", cap);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+// Records a timed loop in the --trace-ring, and marks it in the kernel trace if it's slower than --trace.
+// This runs between loops, so nothing it does is timed.
+static void trace_loop(uint64_t before, uint64_t after, int calls) {
+    double ns = timer_elapsed_ns(before, after) / calls;
+    bool outlier = cb_trace_threshold_ns > 0 && ns > cb_trace_threshold_ns;
+    uint64_t seq = __atomic_fetch_add(trace_ring != NULL ? &trace_ring->head : &trace_seq, 1, __ATOMIC_RELAXED);
+
+#ifdef __linux__
+    if (trace_tid == 0) {
+        trace_tid = syscall(SYS_gettid);
+    }
+#endif
+
+    if (trace_ring != NULL) {
+        trace_entries[seq % trace_ring->len] = (struct trace_ring_entry) {
+            .begin = before,
+            .end = after,
+            .bench = trace_def != NULL ? (uint32_t) (trace_def - benchmarks) : TRACE_OVERHEAD,
+            .calls = calls,
+            .tid = trace_tid,
+            .flags = outlier ? TRACE_OUTLIER : 0,
+        };
+    }
+
+    if (outlier) {
+        char msg[256];
+        int len = snprintf(msg, sizeof(msg), "callbench: %s%s%s seq %llu took %.1f ns per call over %d calls\n",
+            trace_def != NULL ? trace_def->group : "", trace_def != NULL ? "." : "",
+            trace_def != NULL ? trace_def->name : "overhead", (unsigned long long) seq, ns, calls);
+        if (write(trace_marker_fd, msg, len) == len) {
+            atomic_fetch_add(&trace_outliers, 1);
+        }
+    }
+}
+
+// Times each call individually and returns the total for the loop
+static double run_loop_per_call(bench_impl inner_call, int calls, struct sample_buf *samples) {
+    double total_ns = 0;
+
+    for (int call = 0; call < calls; call++) {
+        uint64_t before = timer_begin();
+        inner_call();
+        uint64_t after = timer_end();
+
+        double elapsed_ns = timer_elapsed_ns(before, after);
+        sample_add(samples, elapsed_ns);
+        total_ns += elapsed_ns;
+        if (tracing) {
+            trace_loop(before, after, 1);
+        }
+    }
+
+    return total_ns;
+}
+
+#ifdef HAVE_PERF_EVENTS
+#define CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct perf_event_desc perf_events[NR_PERF_EVENTS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"l1d_misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"llc_misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {"itlb_misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_ITLB)},
+};
+
+static int perf_open_event(const struct perf_event_desc *desc, bool exclude_kernel) {
+    struct perf_event_attr attr = {
+        .type = desc->type,
+        .size = sizeof(attr),
+        .config = desc->config,
+        .disabled = 1,
+        .exclude_kernel = exclude_kernel,
+        .exclude_hv = 1,
+        .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+    };
+
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Opens each event on its own so unsupported ones don't take the rest down with them
+static int perf_open(struct perf_counters *counters) {
+    static bool warned = 0;
+    int nr_open = 0;
+
+    counters->user_only = 0;
+    for (int i = 0; i < NR_PERF_EVENTS; i++) {
+        counters->fds[i] = perf_open_event(&perf_events[i], counters->user_only);
+
+        // Kernel counting needs perf_event_paranoid <= 1 or CAP_PERFMON
+        if (counters->fds[i] < 0 && errno == EACCES && !counters->user_only) {
+            counters->user_only = 1;
+            counters->fds[i] = perf_open_event(&perf_events[i], 1);
+        }
+
+        if (counters->fds[i] >= 0) {
+            nr_open++;
+        }
+    }
+
+    if (!warned && (nr_open == 0 || counters->user_only)) {
+        fprintf(stderr, nr_open ? "warning: perf counters exclude kernel time\n" :
+            "warning: perf counters unavailable: %s\n", strerror(errno));
+        warned = 1;
+    }
+
+    return nr_open ? 0 : -1;
+}
+
+static void perf_control(struct perf_counters *counters, unsigned long request) {
+    for (int i = 0; i < NR_PERF_EVENTS; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], request, 0);
+        }
+    }
+}
+
+// Scales multiplexed counts to the full enabled time and divides them across all calls
+static void perf_close(struct perf_counters *counters, long total_calls, struct bench_result *result) {
+    for (int i = 0; i < NR_PERF_EVENTS; i++) {
+        uint64_t vals[3]; // value, time enabled, time running
+        result->perf_valid[i] = 0;
+
+        if (counters->fds[i] < 0) {
+            continue;
+        }
+
+        if (read(counters->fds[i], vals, sizeof(vals)) == sizeof(vals) && vals[2] > 0) {
+            result->perf[i] = (double) vals[0] * vals[1] / vals[2] / total_calls;
+            result->perf_valid[i] = 1;
+        }
+
+        close(counters->fds[i]);
+    }
+}
+#endif
+
+static void print_perf(struct bench_result *result) {
+#ifdef HAVE_PERF_EVENTS
+    bool any = 0;
+
+    for (int i = 0; i < NR_PERF_EVENTS; i++) {
+        if (result->perf_valid[i]) {
+            printf("%s%.2f %s", any ? ", " : "\t\tper call: ", result->perf[i], perf_events[i].name);
+            any = 1;
+        }
+    }
+
+    if (result->perf_valid[PERF_CYCLES] && result->perf_valid[PERF_INSTRUCTIONS] &&
+            result->perf[PERF_CYCLES] > 0) {
+        printf(" (%.2f IPC)", result->perf[PERF_INSTRUCTIONS] / result->perf[PERF_CYCLES]);
+    }
+
+    if (any) {
+        putchar('\n');
+    }
+#endif
+}
+
+// Keeps the core busy instead of sleeping so it stays out of deep idle states and at a steady clock
+static void spin_warmup(int ms) {
+    long end_ns = clock_ns(CLOCK_MONOTONIC) + (long) ms * NS_PER_MS;
+
+    while (clock_ns(CLOCK_MONOTONIC) < end_ns)
+        ;
+}
+
+// Times one loop of calls, adding its per-call average or every call to samples if not NULL
+static double time_loop(bench_impl inner_call, int calls, struct sample_buf *samples) {
+    if (samples != NULL && samples->per_call) {
+        return run_loop_per_call(inner_call, calls, samples);
+    }
+
+    if (active_loop != NULL) {
+        uint64_t before = timer_begin();
+        active_loop(calls);
+        uint64_t after = timer_end();
+
+        if (tracing) {
+            trace_loop(before, after, calls);
+        }
+        return timer_elapsed_ns(before, after);
+    }
+
+    uint64_t before = timer_begin();
+
+    for (int call = 0; call < calls; call++) {
+        inner_call();
+    }
+
+    uint64_t after = timer_end();
+
+    double elapsed_ns = timer_elapsed_ns(before, after);
+    if (samples != NULL) {
+        sample_add(samples, elapsed_ns / calls);
+    }
+    if (tracing) {
+        trace_loop(before, after, calls);
+    }
+
+    return elapsed_ns;
+}
+
+// samples may be NULL if only the best per-call average is needed
+static double run_bench_ns(bench_impl inner_call, int calls, int loops, int rounds, struct sample_buf *samples) {
+    double best_ns1 = HUGE_VAL;
+
+    for (int round = 0; round < rounds; round++) {
+        double best_ns2 = HUGE_VAL;
+
+        spin_warmup(cb_warmup_ms);
+
+#ifdef HAVE_PERF_EVENTS
+        if (active_perf != NULL)
+            perf_control(active_perf, PERF_EVENT_IOC_ENABLE);
+#endif
+
+        for (int loop = 0; loop < loops; loop++) {
+            double elapsed_ns = time_loop(inner_call, calls, samples);
+
+            if (elapsed_ns < best_ns2) {
+                best_ns2 = elapsed_ns;
+            }
+        }
+
+#ifdef HAVE_PERF_EVENTS
+        if (active_perf != NULL)
+            perf_control(active_perf, PERF_EVENT_IOC_DISABLE);
+#endif
+
+        double round_ns = best_ns2 / calls; // per call in the loop
+
+        if (round_ns < best_ns1) {
+            best_ns1 = round_ns;
+        }
+
+        if (progress && progress_fn != NULL) {
+            progress_fn(progress_ctx);
+        }
+    }
+
+    return best_ns1;
+}
+
+static int hist_bucket(double ns) {
+    long val = (long) ns;
+    if (val < HIST_SUB_BUCKETS) {
+        return val < 0 ? 0 : val;
+    }
+
+    int msb = 63 - __builtin_clzl(val);
+    int sub = (val >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+static long hist_bucket_floor(int bucket) {
+    if (bucket < HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int msb = bucket / HIST_SUB_BUCKETS - 1 + HIST_SUB_BITS;
+    int sub = bucket % HIST_SUB_BUCKETS;
+    return (long) (HIST_SUB_BUCKETS + sub) << (msb - HIST_SUB_BITS);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const double *sorted, long len, double pct) {
+    long rank = (long) (pct / 100 * len + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > len) {
+        rank = len;
+    }
+
+    return sorted[rank - 1];
+}
+
+// Sorts the samples in place after subtracting the harness overhead from each
+static void compute_stats(struct sample_buf *samples, double overhead_ns, struct bench_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->count = samples->len;
+    if (samples->len == 0) {
+        return;
+    }
+
+    for (long i = 0; i < samples->len; i++) {
+        samples->ns[i] = fmax(samples->ns[i] - overhead_ns, 0);
+    }
+
+    qsort(samples->ns, samples->len, sizeof(*samples->ns), cmp_double);
+
+    stats->min = samples->ns[0];
+    stats->p50 = percentile(samples->ns, samples->len, 50);
+    stats->p90 = percentile(samples->ns, samples->len, 90);
+    stats->p99 = percentile(samples->ns, samples->len, 99);
+    stats->p999 = percentile(samples->ns, samples->len, 99.9);
+    stats->max = samples->ns[samples->len - 1];
+
+    for (long i = 0; i < samples->len; i++) {
+        stats->hist[hist_bucket(samples->ns[i])]++;
+    }
+}
+
+static void print_stats(struct bench_stats *stats) {
+    printf("\t\tmin %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f ns  (%ld samples)\n",
+        stats->min, stats->p50, stats->p90, stats->p99, stats->p999, stats->max, stats->count);
+
+    long peak = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (stats->hist[i] > peak) {
+            peak = stats->hist[i];
+        }
+    }
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (stats->hist[i] == 0) {
+            continue;
+        }
+
+        int width = (int) ((stats->hist[i] * HIST_BAR_WIDTH + peak - 1) / peak);
+        printf("\t\t%10ld ns | %-*.*s %ld\n", hist_bucket_floor(i), HIST_BAR_WIDTH, width,
+            "########################################", stats->hist[i]);
+    }
+}
+
+static int alloc_samples(struct sample_buf *samples, int calls, int loops, int rounds, struct options *opts) {
+    long cap = (long) loops * rounds;
+    if (opts->per_call) {
+        cap *= calls;
+    }
+
+    return sample_buf_init(samples, cap, opts->per_call);
+}
+
+// Doubles calls until a loop is measurable, then scales them to last about loop_ns
+static int calibrate_calls(bench_impl inner_call, double loop_ns) {
+    for (long calls = 1;; calls *= 2) {
+        uint64_t before = timer_begin();
+
+        for (long call = 0; call < calls; call++) {
+            inner_call();
+        }
+
+        double elapsed_ns = timer_elapsed_ns(before, timer_end());
+        if (elapsed_ns >= loop_ns / 4 || calls >= INT_MAX / 2) {
+            double scaled = elapsed_ns > 0 ? calls * loop_ns / elapsed_ns : calls;
+            return (int) fmax(fmin(scaled, INT_MAX), 1);
+        }
+    }
+}
+
+// Distribution-free 95% confidence interval on the median of sorted samples
+static void median_ci(const double *sorted, long len, double *lo, double *hi) {
+    double spread = 1.96 * sqrt(len) / 2;
+    long lo_rank = (long) floor(len / 2.0 - spread);
+    long hi_rank = (long) ceil(len / 2.0 + spread);
+
+    *lo = sorted[lo_rank < 0 ? 0 : lo_rank];
+    *hi = sorted[hi_rank >= len ? len - 1 : hi_rank];
+}
+
+// Relative half-width of the CI on the median of the raw samples collected so far
+static double median_rel_error(struct sample_buf *samples, double overhead_ns) {
+    if (samples->len < 2) {
+        return HUGE_VAL;
+    }
+
+    double *sorted = malloc(samples->len * sizeof(*sorted));
+    if (sorted == NULL) {
+        return HUGE_VAL;
+    }
+
+    memcpy(sorted, samples->ns, samples->len * sizeof(*sorted));
+    qsort(sorted, samples->len, sizeof(*sorted), cmp_double);
+
+    double lo, hi;
+    median_ci(sorted, samples->len, &lo, &hi);
+    double median = fmax(percentile(sorted, samples->len, 50) - overhead_ns, 0);
+    free(sorted);
+
+    return median > 0 ? (hi - lo) / 2 / median : HUGE_VAL;
+}
+
+// Summarizes samples that compute_stats has already corrected and sorted
+static void compute_summary(struct sample_buf *samples, struct bench_summary *summary) {
+    long len = samples->len;
+    double *ns = samples->ns;
+    if (len == 0) {
+        return;
+    }
+
+    double sum = 0, sum_sq = 0;
+    for (long i = 0; i < len; i++) {
+        sum += ns[i];
+    }
+    summary->mean = sum / len;
+
+    for (long i = 0; i < len; i++) {
+        sum_sq += (ns[i] - summary->mean) * (ns[i] - summary->mean);
+    }
+    summary->stddev = len > 1 ? sqrt(sum_sq / (len - 1)) : 0;
+
+    summary->median = percentile(ns, len, 50);
+    median_ci(ns, len, &summary->ci_lo, &summary->ci_hi);
+
+    // Tukey's fences
+    double q1 = percentile(ns, len, 25);
+    double q3 = percentile(ns, len, 75);
+    double iqr = q3 - q1;
+    for (long i = 0; i < len; i++) {
+        if (ns[i] < q1 - 1.5 * iqr || ns[i] > q3 + 1.5 * iqr) {
+            summary->outliers++;
+        }
+    }
+}
+
+// Runs rounds until the median is known to within the target error or the time budget runs out
+static double run_adaptive(bench_impl inner_call, int calls, int loops, struct options *opts,
+                           double overhead_ns, struct sample_buf *samples, struct bench_summary *summary) {
+    long deadline_ns = clock_ns(CLOCK_MONOTONIC) + (long) (opts->budget_s * NS_PER_SEC);
+    double best_ns = HUGE_VAL;
+
+    for (int round = 1;; round++) {
+        best_ns = fmin(best_ns, run_bench_ns(inner_call, calls, loops, 1, samples));
+        summary->rounds = round;
+
+        if (round >= MIN_ADAPTIVE_ROUNDS && median_rel_error(samples, overhead_ns) <= opts->adaptive) {
+            summary->converged = 1;
+            break;
+        }
+
+        if (clock_ns(CLOCK_MONOTONIC) >= deadline_ns) {
+            break;
+        }
+    }
+
+    return best_ns;
+}
+
+// Runs a benchmark and subtracts the harness overhead, collecting its distribution if requested
+static int run_bench(struct bench_run *run, struct options *opts) {
+    bench_impl inner_call = run->def->impl;
+    struct bench_result *result = &run->result;
+    double overhead_ns = run->overhead_ns;
+
+    struct sample_buf samples = { 0 };
+    if (opts->adaptive || opts->dist || opts->keep_samples) {
+        int ret = alloc_samples(&samples, run->calls, run->loops,
+            opts->adaptive ? MIN_ADAPTIVE_ROUNDS : run->rounds, opts);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+#ifdef HAVE_PERF_EVENTS
+    struct perf_counters counters;
+    if (opts->perf && perf_open(&counters) == 0) {
+        active_perf = &counters;
+    }
+#endif
+
+    if (opts->adaptive) {
+        result->raw_ns = run_adaptive(inner_call, run->calls, run->loops, opts, overhead_ns,
+            &samples, &result->summary);
+        run->rounds = result->summary.rounds;
+
+        compute_stats(&samples, overhead_ns, &result->stats);
+        compute_summary(&samples, &result->summary);
+        result->summary.count = samples.len;
+        run->samples = samples;
+    } else if (!opts->dist && !opts->keep_samples) {
+        result->raw_ns = run_bench_ns(inner_call, run->calls, run->loops, run->rounds, NULL);
+    } else {
+        result->raw_ns = run_bench_ns(inner_call, run->calls, run->loops, run->rounds, &samples);
+        compute_stats(&samples, overhead_ns, &result->stats);
+        run->samples = samples;
+    }
+
+#ifdef HAVE_PERF_EVENTS
+    if (active_perf != NULL) {
+        active_perf = NULL;
+        perf_close(&counters, (long) run->calls * run->loops * run->rounds, result);
+    }
+#endif
+
+    result->ns = fmax(result->raw_ns - overhead_ns, 0);
+    return 0;
+}
+
+// Deliberately does nothing so that timing it leaves only the harness overhead
+__attribute__((noinline)) static void empty_mb(void) {
+    __asm__ volatile("" ::: "memory");
+}
+
+// The same for --inline, where only the loop itself and the timer reads remain
+static inline void empty_inline_mb(void) {
+    __asm__ volatile("" ::: "memory");
+}
+DEFINE_INLINE_LOOPS(empty_inline_mb);
+
+int cb_unroll_index(int unroll) {
+    for (int i = 0; i < NR_UNROLL_FACTORS; i++) {
+        if (cb_unroll_factors[i] == unroll) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+// Times the benchmark's specialized loop with the same loop shape, to quantify dispatch overhead
+static void run_inlined(struct bench_run *run, struct options *opts) {
+    int index = cb_unroll_index(opts->unroll);
+
+    active_loop = empty_inline_mb_inline[index];
+    run->inline_overhead_ns = run_bench_ns(empty_mb, run->calls, run->loops, OVERHEAD_ROUNDS, NULL);
+
+    active_loop = run->def->inlined[index];
+    run->inline_raw_ns = run_bench_ns(run->def->impl, run->calls, run->loops, run->rounds, NULL);
+    active_loop = NULL;
+
+    run->inline_ns = fmax(run->inline_raw_ns - run->inline_overhead_ns, 0);
+    run->inlined = 1;
+}
+
+// Per-call cost of the loop, bench_impl dispatch and amortized timer reads for this loop shape
+static int measure_overhead(int calls, int loops, struct options *opts, double *overhead_ns) {
+    struct sample_buf samples;
+    struct sample_buf *samples_ptr = NULL;
+
+    // Per-call timing puts a timer read around every call, so calibrate with it too
+    if (opts->per_call) {
+        int ret = alloc_samples(&samples, calls, loops, OVERHEAD_ROUNDS, opts);
+        if (ret != 0) {
+            return ret;
+        }
+        samples_ptr = &samples;
+    }
+
+    const struct bench_def *def = trace_def;
+    trace_def = NULL;
+    *overhead_ns = run_bench_ns(empty_mb, calls, loops, OVERHEAD_ROUNDS, samples_ptr);
+    trace_def = def;
+
+    if (samples_ptr != NULL) {
+        sample_buf_free(samples_ptr);
+    }
+
+    return 0;
+}
+
+// Parses a CPU list such as "2" or "0-3,8" into cpus
+int cb_parse_cpu_list(const char *list, int *cpus, int max) {
+    int count = 0;
+    const char *p = list;
+
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return -1;
+        }
+
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (count == max) {
+                return -1;
+            }
+
+            cpus[count++] = cpu;
+        }
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+
+        p = end;
+    }
+
+    return count;
+}
+
+// Discovers NUMA nodes and the first allowed CPU of each, which is -1 for memory-only nodes
+void cb_init_numa_topology(void) {
+    int cpus[MAX_THREADS];
+    int nr_cpus = get_cpus(cpus, MAX_THREADS);
+
+    DIR *dir = opendir("/sys/devices/system/node");
+    struct dirent *ent;
+    while (dir != NULL && (ent = readdir(dir)) != NULL) {
+        int node;
+        char end;
+        if (sscanf(ent->d_name, "node%d%c", &node, &end) != 1 || nr_numa_nodes == MAX_NUMA_NODES ||
+                node >= MAX_NUMA_NODES) {
+            continue;
+        }
+
+        char path[320], list[4096];
+        int node_cpus[MAX_THREADS];
+        int nr_node_cpus = 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", ent->d_name);
+        if (read_sysfs_line(path, list, sizeof(list)) == 0 && list[0] != '\0') {
+            nr_node_cpus = cb_parse_cpu_list(list, node_cpus, MAX_THREADS);
+        }
+
+        struct numa_node *n = &numa_nodes[nr_numa_nodes++];
+        n->node = node;
+        n->cpu = -1;
+        for (int i = 0; i < nr_node_cpus && n->cpu == -1; i++) {
+            for (int j = 0; j < nr_cpus; j++) {
+                if (cpus[j] == node_cpus[i]) {
+                    n->cpu = cpus[j];
+                    break;
+                }
+            }
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+
+    // Kernels without NUMA support have one implicit node
+    if (nr_numa_nodes == 0) {
+        numa_nodes[0].node = 0;
+        numa_nodes[0].cpu = nr_cpus > 0 ? cpus[0] : 0;
+        nr_numa_nodes = 1;
+    }
+
+    // readdir order is arbitrary
+    for (int i = 1; i < nr_numa_nodes; i++) {
+        for (int j = i; j > 0 && numa_nodes[j - 1].node > numa_nodes[j].node; j--) {
+            struct numa_node tmp = numa_nodes[j];
+            numa_nodes[j] = numa_nodes[j - 1];
+            numa_nodes[j - 1] = tmp;
+        }
+    }
+}
+
+// Restricts this thread's future allocations to one node
+static int bind_mempolicy(int node) {
+#ifdef __NR_set_mempolicy
+    unsigned long mask = 1UL << node;
+    return syscall(__NR_set_mempolicy, MPOL_BIND, &mask, sizeof(mask) * 8 + 1);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Moves memory that may have been recycled from another node's allocations by malloc
+static void bind_memory(void *addr, long len, int node) {
+#ifdef __NR_mbind
+    unsigned long mask = 1UL << node;
+    syscall(__NR_mbind, addr, len, MPOL_BIND, &mask, sizeof(mask) * 8 + 1, MPOL_MF_MOVE);
+#endif
+}
+
+// Falls back to /proc/cpuinfo for systems without cpufreq, e.g. most VMs
+static double cpu_freq_mhz(int cpu) {
+    char path[128];
+    char buf[64];
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu);
+    if (read_sysfs_line(path, buf, sizeof(buf)) == 0) {
+        return atol(buf) / 1000.0;
+    }
+
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    char line[256];
+    int cur_cpu = -1;
+    double mhz = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        sscanf(line, "processor : %d", &cur_cpu);
+        if (cur_cpu == cpu && sscanf(line, "cpu MHz : %lf", &mhz) == 1) {
+            break;
+        }
+    }
+
+    fclose(f);
+    return mhz;
+}
+
+struct cpu_state {
+    int cpu;
+    char governor[64];
+    double mhz;
+};
+
+static void get_cpu_state(struct cpu_state *state) {
+    char path[128];
+
+    state->cpu = -1;
+    state->mhz = 0;
+    strcpy(state->governor, "unknown");
+
+#ifdef __linux__
+    state->cpu = sched_getcpu();
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", state->cpu);
+    read_sysfs_line(path, state->governor, sizeof(state->governor));
+    state->mhz = cpu_freq_mhz(state->cpu);
+#endif
+}
+
+static void print_cpu_state(void) {
+    if (cb_output_format != FORMAT_TEXT)
+        return;
+
+#ifdef __linux__
+    struct cpu_state state;
+    get_cpu_state(&state);
+
+    if (state.mhz > 0) {
+        printf("    cpu:\t%d (%s governor, %.0f MHz)\n", state.cpu, state.governor, state.mhz);
+    } else {
+        printf("    cpu:\t%d (%s governor, unknown frequency)\n", state.cpu, state.governor);
+    }
+#endif
+}
+
+static void read_cpu_model(char *buf, int len) {
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f == NULL) {
+        return;
+    }
+
+    // x86 has "model name", arm64 only has implementer/part IDs
+    char line[256];
+    char implementer[32] = "", part[32] = "";
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *val = strchr(line, ':');
+        if (val == NULL) {
+            continue;
+        }
+
+        val += strspn(val + 1, " \t") + 1;
+        val[strcspn(val, "\n")] = '\0';
+
+        if (!strncmp(line, "model name", 10) || !strncmp(line, "Hardware", 8)) {
+            snprintf(buf, len, "%s", val);
+            break;
+        } else if (!strncmp(line, "CPU implementer", 15)) {
+            snprintf(implementer, sizeof(implementer), "%s", val);
+        } else if (!strncmp(line, "CPU part", 8)) {
+            snprintf(part, sizeof(part), "%s", val);
+        }
+    }
+
+    if (buf[0] == '\0' && implementer[0] != '\0') {
+        snprintf(buf, len, "implementer %s part %s", implementer, part);
+    }
+
+    fclose(f);
+}
+
+// Joins every CPU vulnerability status into "name=status|..."
+static void read_mitigations(char *buf, int len) {
+    const char *dir_path = "/sys/devices/system/cpu/vulnerabilities";
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        return;
+    }
+
+    char *names[64];
+    int count = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL && count < 64) {
+        if (ent->d_name[0] != '.') {
+            names[count++] = strdup(ent->d_name);
+        }
+    }
+    closedir(dir);
+
+    qsort(names, count, sizeof(*names), cmp_str);
+
+    int pos = 0;
+    for (int i = 0; i < count; i++) {
+        char path[512];
+        char status[256];
+
+        snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+        if (read_sysfs_line(path, status, sizeof(status)) == 0 && pos < len) {
+            pos += snprintf(buf + pos, len - pos, "%s%s=%s", pos ? HOST_LIST_SEP : "", names[i], status);
+        }
+
+        free(names[i]);
+    }
+}
+
+// Whether PTI is on, going by the Meltdown status on both x86 and arm64
+static void read_pti(char *buf, int len) {
+    char status[256];
+    if (read_sysfs_line("/sys/devices/system/cpu/vulnerabilities/meltdown", status, sizeof(status)) != 0) {
+        snprintf(buf, len, "unknown");
+    } else if (strstr(status, "PTI") != NULL) {
+        snprintf(buf, len, "on");
+    } else if (!strcmp(status, "Not affected")) {
+        snprintf(buf, len, "not affected");
+    } else {
+        snprintf(buf, len, "off");
+    }
+}
+
+// Names the hypervisor, since VM exits and paravirtual clocks change syscall costs
+static void read_virtualization(char *buf, int len) {
+#if defined(__x86_64__) || defined(__i386__)
+    static const struct {
+        const char *signature;
+        const char *name;
+    } hypervisors[] = {
+        { "KVMKVMKVM", "KVM" },
+        { "Microsoft Hv", "Hyper-V" },
+        { "VMwareVMware", "VMware" },
+        { "XenVMMXenVMM", "Xen" },
+        { "TCGTCGTCGTCG", "QEMU TCG" },
+        { "bhyve bhyve ", "bhyve" },
+        { "ACRNACRNACRN", "ACRN" },
+    };
+
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & (1U << 31))) {
+        snprintf(buf, len, "none");
+        return;
+    }
+
+    char signature[13];
+    __cpuid(0x40000000, eax, ebx, ecx, edx);
+    memcpy(signature, &ebx, 4);
+    memcpy(signature + 4, &ecx, 4);
+    memcpy(signature + 8, &edx, 4);
+    signature[12] = '\0';
+
+    for (int i = 0; i < (int) ARRAY_SIZE(hypervisors); i++) {
+        if (!strcmp(signature, hypervisors[i].signature)) {
+            snprintf(buf, len, "%s", hypervisors[i].name);
+            return;
+        }
+    }
+    snprintf(buf, len, "%s", signature[0] ? signature : "unknown");
+#else
+    if (read_sysfs_line("/sys/hypervisor/type", buf, len) != 0 || buf[0] == '\0') {
+        snprintf(buf, len, "unknown");
+    }
+#endif
+}
+
+#ifdef __linux__
+// Joins the per-task state of every speculation control into "name=prctl:disable|..."
+static void read_spec_ctrls(char *buf, int len) {
+    int pos = 0;
+    for (int i = 0; i < NR_SPEC_CTRLS && pos < len; i++) {
+        int state = prctl(PR_GET_SPECULATION_CTRL, spec_ctrls[i].which, 0, 0, 0);
+        const char *mode = state & PR_SPEC_FORCE_DISABLE ? "force-disable" :
+            state & PR_SPEC_DISABLE_NOEXEC ? "disable-noexec" :
+            state & PR_SPEC_DISABLE ? "disable" : state & PR_SPEC_ENABLE ? "enable" : "";
+
+        char status[32];
+        if (state < 0) {
+            snprintf(status, sizeof(status), "unsupported");
+        } else if (state == PR_SPEC_NOT_AFFECTED) {
+            snprintf(status, sizeof(status), "not affected");
+        } else {
+            snprintf(status, sizeof(status), "%s:%s", state & PR_SPEC_PRCTL ? "prctl" : "fixed", mode);
+        }
+
+        // The loop stops once this truncates, before len - pos can go negative
+        pos += snprintf(buf + pos, len - pos, "%s%s=%s", pos ? HOST_LIST_SEP : "", spec_ctrls[i].name, status);
+    }
+}
+
+// Turns a speculation mitigation on for the calling thread only
+static int apply_spec_ctrl(int index) {
+    const struct spec_ctrl *ctrl = &spec_ctrls[index];
+    return prctl(PR_SET_SPECULATION_CTRL, ctrl->which, ctrl->value, 0, 0);
+}
+#else
+static void read_spec_ctrls(char *buf, int len) {
+    snprintf(buf, len, "unsupported");
+}
+
+static int apply_spec_ctrl(int index) {
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+// Whether the whole process already runs under seccomp, e.g. in a container
+static void read_seccomp_mode(char *buf, int len) {
+    static const char *modes[] = { "disabled", "strict", "filter" };
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) {
+        return;
+    }
+
+    char line[256];
+    int mode;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "Seccomp: %d", &mode) == 1 && mode >= 0 && mode < (int) ARRAY_SIZE(modes)) {
+            snprintf(buf, len, "%s", modes[mode]);
+            break;
+        }
+    }
+
+    fclose(f);
+}
+
+void cb_init_host_info(void) {
+    struct utsname uts;
+    if (uname(&uts) == 0) {
+        snprintf(host_info.kernel, sizeof(host_info.kernel), "%s %s %s", uts.sysname, uts.release, uts.version);
+        snprintf(host_info.machine, sizeof(host_info.machine), "%s", uts.machine);
+    }
+
+    read_cpu_model(host_info.cpu_model, sizeof(host_info.cpu_model));
+    read_sysfs_line("/sys/devices/system/clocksource/clocksource0/current_clocksource",
+        host_info.clocksource, sizeof(host_info.clocksource));
+    read_mitigations(host_info.mitigations, sizeof(host_info.mitigations));
+    read_sysfs_line("/sys/kernel/mm/transparent_hugepage/enabled", host_info.thp, sizeof(host_info.thp));
+    read_seccomp_mode(host_info.seccomp, sizeof(host_info.seccomp));
+    read_pti(host_info.pti, sizeof(host_info.pti));
+    read_virtualization(host_info.virtualization, sizeof(host_info.virtualization));
+    read_spec_ctrls(host_info.spec_ctrl, sizeof(host_info.spec_ctrl));
+    read_sysfs_line("/proc/cmdline", host_info.cmdline, sizeof(host_info.cmdline));
+}
+
+// Summarizes what affects syscall costs on this host, before any results
+void cb_print_host_info(void) {
+    printf("host: %s on %s, %s virtualization, clocksource %s, PTI %s, seccomp %s\n",
+        host_info.kernel, host_info.machine, host_info.virtualization, host_info.clocksource,
+        host_info.pti, host_info.seccomp);
+
+    // Vulnerabilities the CPU isn't affected by cost nothing, so leave them out
+    printf("mitigations:");
+    char *list = strdup(host_info.mitigations);
+    char *save;
+    int printed = 0;
+    for (char *ent = strtok_r(list, HOST_LIST_SEP, &save); ent != NULL; ent = strtok_r(NULL, HOST_LIST_SEP, &save)) {
+        if (strstr(ent, "=Not affected") == NULL) {
+            printf("%s %s", printed++ ? " " HOST_LIST_SEP : "", ent);
+        }
+    }
+    free(list);
+    printf("%s\n", printed ? "" : " none needed");
+
+    printf("speculation controls: %s\n", host_info.spec_ctrl);
+    printf("cmdline: %s\n\n", host_info.cmdline);
+}
+
+static void record_add(struct record *rec, const char *key, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    rec->keys[rec->len] = key;
+    if (vasprintf(&rec->vals[rec->len], fmt, args) < 0) {
+        rec->vals[rec->len] = NULL;
+    }
+    va_end(args);
+
+    rec->quoted[rec->len] = 0;
+    rec->len++;
+}
+
+static void record_add_str(struct record *rec, const char *key, const char *val) {
+    record_add(rec, key, "%s", val);
+    rec->quoted[rec->len - 1] = 1;
+}
+
+static void record_add_num(struct record *rec, const char *key, double val, bool valid) {
+    if (valid) {
+        record_add(rec, key, "%.3f", val);
+    } else {
+        record_add(rec, key, "");
+    }
+}
+
+static void print_json_str(const char *str) {
+    putchar('"');
+    for (const char *p = str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            printf("\\%c", *p);
+        } else if ((unsigned char) *p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+static void print_csv_str(const char *str) {
+    putchar('"');
+    for (const char *p = str; *p; p++) {
+        if (*p == '"') {
+            putchar('"');
+        }
+        putchar(*p);
+    }
+    putchar('"');
+}
+
+// Prints a JSON line or CSV row and frees its values
+static void record_emit(struct record *rec) {
+    static bool csv_header_done = 0;
+
+    if (cb_output_format == FORMAT_CSV && !csv_header_done) {
+        for (int i = 0; i < rec->len; i++) {
+            printf("%s%s", i ? "," : "", rec->keys[i]);
+        }
+        putchar('\n');
+        csv_header_done = 1;
+    }
+
+    if (cb_output_format == FORMAT_JSON) {
+        putchar('{');
+    }
+
+    for (int i = 0; i < rec->len; i++) {
+        const char *val = rec->vals[i] ? rec->vals[i] : "";
+
+        if (cb_output_format == FORMAT_JSON) {
+            printf("%s\"%s\": ", i ? ", " : "", rec->keys[i]);
+            if (rec->quoted[i]) {
+                print_json_str(val);
+            } else {
+                printf("%s", val[0] ? val : "null");
+            }
+        } else {
+            if (i)
+                putchar(',');
+            if (rec->quoted[i])
+                print_csv_str(val);
+            else
+                printf("%s", val);
+        }
+
+        free(rec->vals[i]);
+    }
+
+    if (cb_output_format == FORMAT_JSON) {
+        putchar('}');
+    }
+
+    putchar('\n');
+    fflush(stdout);
+}
+
+static int run_ops(struct bench_run *run) {
+    return run->batch ? run->batch : 1;
+}
+
+static long run_pages(struct bench_run *run) {
+    return run->def->flags & BENCH_PAGED ? (run->size + page_size - 1) / page_size : 0;
+}
+
+// Emits one machine-readable record with the run parameters and host metadata
+static void report_record(struct bench_run *run) {
+    struct record rec = { .len = 0 };
+    struct bench_result *result = &run->result;
+    struct bench_stats *stats = &result->stats;
+    bool has_stats = stats->count > 0;
+    struct bench_summary *summary = &result->summary;
+    bool has_summary = summary->count > 0;
+
+    struct cpu_state cpu;
+    get_cpu_state(&cpu);
+
+    record_add_str(&rec, "group", run->def->group);
+    record_add_str(&rec, "name", run->def->name);
+    record_add(&rec, "calls", "%d", run->calls);
+    record_add(&rec, "loops", "%d", run->loops);
+    record_add(&rec, "rounds", "%d", run->rounds);
+    record_add(&rec, "threads", "%d", run->threads);
+    record_add_str(&rec, "timer", timer_type == TIMER_CYCLES ? "cycles" : "clock");
+    record_add_num(&rec, "timer_overhead_ns", cb_timer_overhead_ns, 1);
+    record_add_num(&rec, "overhead_ns", run->overhead_ns, 1);
+    record_add_num(&rec, "raw_ns", result->raw_ns, 1);
+    record_add_num(&rec, "ns", result->ns, 1);
+    record_add_num(&rec, "calls_per_sec", run->calls_per_sec, 1);
+    if (run->size)
+        record_add(&rec, "size_bytes", "%ld", run->size);
+    else
+        record_add(&rec, "size_bytes", "");
+    record_add_num(&rec, "gb_per_sec", run->size * run_ops(run) * run->calls_per_sec / NS_PER_SEC, run->size > 0);
+    record_add(&rec, "ops_per_call", "%d", run_ops(run));
+    record_add_num(&rec, "ns_per_op", result->ns / run_ops(run), 1);
+    record_add_num(&rec, "ops_per_sec", run->calls_per_sec * run_ops(run), 1);
+    if (run->cpu_node >= 0) {
+        record_add(&rec, "cpu_node", "%d", numa_nodes[run->cpu_node].node);
+        record_add(&rec, "mem_node", "%d", numa_nodes[run->mem_node].node);
+    } else {
+        record_add(&rec, "cpu_node", "");
+        record_add(&rec, "mem_node", "");
+    }
+    record_add_str(&rec, "spec_ctrl", run->spec_ctrl >= 0 ? spec_ctrls[run->spec_ctrl].name : "");
+    record_add_num(&rec, "spec_delta_ns", run->result.ns - run->spec_base_ns,
+        run->spec_ctrl >= 0 && run->spec_base_ns > 0);
+    record_add_num(&rec, "ns_per_page", result->ns / run_pages(run), run_pages(run) > 0);
+    if (run->vdso_fallback >= 0)
+        record_add(&rec, "vdso_fallback", run->vdso_fallback ? "true" : "false");
+    else
+        record_add(&rec, "vdso_fallback", "");
+    record_add(&rec, "samples", "%ld", stats->count);
+    record_add_num(&rec, "min_ns", stats->min, has_stats);
+    record_add_num(&rec, "p50_ns", stats->p50, has_stats);
+    record_add_num(&rec, "p90_ns", stats->p90, has_stats);
+    record_add_num(&rec, "p99_ns", stats->p99, has_stats);
+    record_add_num(&rec, "p999_ns", stats->p999, has_stats);
+    record_add_num(&rec, "max_ns", stats->max, has_stats);
+    record_add_num(&rec, "mean_ns", summary->mean, has_summary);
+    record_add_num(&rec, "stddev_ns", summary->stddev, has_summary);
+    record_add_num(&rec, "median_ns", summary->median, has_summary);
+    record_add_num(&rec, "ci_low_ns", summary->ci_lo, has_summary);
+    record_add_num(&rec, "ci_high_ns", summary->ci_hi, has_summary);
+    record_add(&rec, "handoffs", "%ld", run->handoff.count);
+    record_add_num(&rec, "handoff_p50_ns", run->handoff.p50, run->handoff.count > 0);
+    record_add_num(&rec, "handoff_p99_ns", run->handoff.p99, run->handoff.count > 0);
+    record_add_num(&rec, "handoff_max_ns", run->handoff.max, run->handoff.count > 0);
+    record_add_num(&rec, "inline_raw_ns", run->inline_raw_ns, run->inlined);
+    record_add_num(&rec, "inline_ns", run->inline_ns, run->inlined);
+    record_add_num(&rec, "dispatch_ns", result->raw_ns - run->inline_raw_ns, run->inlined);
+    record_add_num(&rec, "baseline_median_ns", run->compare.base_median, run->compare.valid);
+    record_add_num(&rec, "baseline_delta", run->compare.delta, run->compare.valid);
+    if (run->compare.valid) {
+        record_add(&rec, "baseline_p", "%.3g", run->compare.p);
+        record_add(&rec, "regression", run->compare.regression ? "true" : "false");
+    } else {
+        record_add(&rec, "baseline_p", "");
+        record_add(&rec, "regression", "");
+    }
+    if (has_summary) {
+        record_add(&rec, "outliers", "%ld", summary->outliers);
+        record_add(&rec, "converged", summary->converged ? "true" : "false");
+    } else {
+        record_add(&rec, "outliers", "");
+        record_add(&rec, "converged", "");
+    }
+#ifdef HAVE_PERF_EVENTS
+    for (int i = 0; i < NR_PERF_EVENTS; i++) {
+        record_add_num(&rec, perf_events[i].name, result->perf[i], result->perf_valid[i]);
+    }
+#endif
+    record_add(&rec, "cpu", "%d", cpu.cpu);
+    record_add_str(&rec, "governor", cpu.governor);
+    record_add_num(&rec, "cpu_mhz", cpu.mhz, cpu.mhz > 0);
+    record_add_str(&rec, "kernel", host_info.kernel);
+    record_add_str(&rec, "machine", host_info.machine);
+    record_add_str(&rec, "cpu_model", host_info.cpu_model);
+    record_add_str(&rec, "clocksource", host_info.clocksource);
+    record_add_str(&rec, "mitigations", host_info.mitigations);
+    record_add_str(&rec, "thp", host_info.thp);
+    record_add_str(&rec, "seccomp", host_info.seccomp);
+    record_add_str(&rec, "pti", host_info.pti);
+    record_add_str(&rec, "virtualization", host_info.virtualization);
+    record_add_str(&rec, "spec_ctrl_state", host_info.spec_ctrl);
+    record_add_str(&rec, "cmdline", host_info.cmdline);
+
+    record_emit(&rec);
+}
+
+// Pins the main thread and applies the requested scheduling and memory controls
+int cb_init_isolation(struct options *opts) {
+#ifdef __linux__
+    if (cb_nr_cpu_list > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cb_cpu_list[0], &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            perror("sched_setaffinity");
+            return -errno;
+        }
+    }
+#endif
+
+    if (opts->fifo_prio > 0) {
+        struct sched_param param = {
+            .sched_priority = opts->fifo_prio,
+        };
+
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            perror("sched_setscheduler");
+            return -errno;
+        }
+    }
+
+    if (opts->mlock && mlockall(MCL_CURRENT) != 0) {
+        perror("mlockall");
+        return -errno;
+    }
+
+    return 0;
+}
+
+// All workers spin here so they enter the timed region together
+static void barrier_wait(struct spin_barrier *barrier) {
+    int generation = atomic_load(&barrier->generation);
+
+    if (atomic_fetch_add(&barrier->count, 1) == barrier->total - 1) {
+        atomic_store(&barrier->count, 0);
+        atomic_fetch_add(&barrier->generation, 1);
+    } else {
+        while (atomic_load(&barrier->generation) == generation) {
+            sched_yield();
+        }
+    }
+}
+
+// Arrives at the barrier for workers that were never started, so the ones that were don't wait forever
+static void barrier_abandon(struct spin_barrier *barrier, int missing) {
+    atomic_store(&barrier->abort, 1);
+    if (atomic_fetch_add(&barrier->count, missing) + missing == barrier->total) {
+        atomic_store(&barrier->count, 0);
+        atomic_fetch_add(&barrier->generation, 1);
+    }
+}
+
+// Allocates a page-aligned buffer for the largest transfer and faults it in on the current node,
+// or returns NULL if it can't
+static char *alloc_read_buf(void) {
+    void *buf;
+    int ret = posix_memalign(&buf, page_size, read_buf_size);
+    if (ret != 0) {
+        fprintf(stderr, "failed to allocate %ld-byte buffer: %s\n", read_buf_size, strerror(ret));
+        return NULL;
+    }
+
+    memset(buf, 0, read_buf_size);
+    return buf;
+}
+
+// Makes this thread's allocations prefer its own NUMA node, even under a process-wide policy
+static void set_local_mempolicy(void) {
+#ifdef __NR_set_mempolicy
+    syscall(__NR_set_mempolicy, MPOL_LOCAL, NULL, 0);
+#endif
+}
+
+static void *worker_main(void *arg) {
+    struct worker *worker = arg;
+    const struct bench_def *def = worker->def;
+
+    if (pin_thread(worker->cpu) != 0) {
+        fprintf(stderr, "failed to pin worker to CPU %d\n", worker->cpu);
+    }
+
+    // Set up after pinning so the worker's buffer and kernel objects are local to its CPU
+    set_local_mempolicy();
+    test_read_buf = alloc_read_buf();
+    if (test_read_buf == NULL) {
+        worker->error = -ENOMEM;
+    } else if (def->setup && def->setup(def) != 0) {
+        fprintf(stderr, "failed to set up %s on CPU %d\n", def->name, worker->cpu);
+        worker->error = -EIO;
+    }
+
+    if (worker->error != 0) {
+        atomic_store(&worker->barrier->abort, 1);
+    }
+
+    barrier_wait(worker->barrier);
+    if (worker->error == 0 && !atomic_load(&worker->barrier->abort)) {
+        worker->ns = run_bench_ns(def->impl, worker->calls, worker->loops, worker->rounds, NULL);
+    }
+
+    if (worker->error == 0 && def->teardown) {
+        def->teardown(def);
+    }
+    free(test_read_buf);
+
+    return NULL;
+}
+
+static void *stressor_main(void *arg) {
+    struct stressor *stressor = arg;
+    char *src = stressor->src, *dst = stressor->dst;
+
+    if (stressor->cpu >= 0) {
+        pin_thread(stressor->cpu);
+    }
+
+    // Fault the buffers in from the stressor's own CPU
+    if (stressor->kind == STRESS_MEM) {
+        memset(src, 1, STRESS_MEM_SIZE);
+    }
+
+    while (!atomic_load_explicit(&stressors_stop, memory_order_relaxed)) {
+        switch (stressor->kind) {
+        case STRESS_CPU:
+            for (int i = 0; i < 1000000; i++) {
+                __asm__ volatile("" ::: "memory");
+            }
+            break;
+        case STRESS_MEM:
+            memcpy(dst, src, STRESS_MEM_SIZE);
+            __asm__ volatile("" :: "r" (dst) : "memory");
+            break;
+        case STRESS_SYSCALL:
+            for (int i = 0; i < 1000; i++) {
+                syscall(__NR_getpid);
+            }
+            break;
+        case STRESS_FAULT: {
+            // Unmapping in a multi-threaded process also sends TLB shootdowns to the benchmark's CPU
+            char *data = mmap(NULL, STRESS_FAULT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data != MAP_FAILED) {
+                for (long off = 0; off < STRESS_FAULT_SIZE; off += page_size) {
+                    data[off] = 1;
+                }
+                munmap(data, STRESS_FAULT_SIZE);
+            }
+            break;
+        }
+        }
+    }
+
+    return NULL;
+}
+
+// Starts the --stress threads, spread over the CPUs other than the benchmark's when there are any
+int cb_start_stressors(void) {
+    int cpus[MAX_THREADS];
+    int nr_cpus = get_cpus(cpus, MAX_THREADS);
+    int self = sched_getcpu();
+    int next = 0;
+
+    for (int i = 0; i < cb_nr_stressors; i++) {
+        struct stressor *stressor = &stressors[i];
+        stressor->cpu = -1;
+
+        for (int tries = 0; tries < nr_cpus; tries++) {
+            int cpu = cpus[next++ % nr_cpus];
+            if (cpu != self || nr_cpus == 1) {
+                stressor->cpu = cpu;
+                break;
+            }
+        }
+
+        int ret = 0;
+        if (stressor->kind == STRESS_MEM) {
+            stressor->src = malloc(STRESS_MEM_SIZE);
+            stressor->dst = malloc(STRESS_MEM_SIZE);
+            if (stressor->src == NULL || stressor->dst == NULL) {
+                fprintf(stderr, "failed to allocate memory stressor buffers\n");
+                ret = ENOMEM;
+            }
+        }
+
+        if (ret == 0) {
+            ret = pthread_create(&stressor->thread, NULL, stressor_main, stressor);
+            if (ret != 0) {
+                fprintf(stderr, "failed to create stressor thread: %s\n", strerror(ret));
+            }
+        }
+
+        if (ret != 0) {
+            free(stressor->src);
+            free(stressor->dst);
+            stressor->src = stressor->dst = NULL;
+            // Only stop the threads that did start
+            cb_nr_stressors = i;
+            cb_stop_stressors();
+            return -ret;
+        }
+    }
+
+    return 0;
+}
+
+void cb_stop_stressors(void) {
+    atomic_store(&stressors_stop, 1);
+    for (int i = 0; i < cb_nr_stressors; i++) {
+        pthread_join(stressors[i].thread, NULL);
+        free(stressors[i].src);
+        free(stressors[i].dst);
+    }
+}
+
+// Parses a list of stressor kinds with optional thread counts, e.g. cpu:2,mem
+int cb_parse_stressors(const char *arg) {
+    static const char *kinds[] = { "cpu", "mem", "syscall", "fault" };
+    char *list = strdup(arg);
+    int count = 0;
+
+    for (char *item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *sep = strchr(item, ':');
+        int threads = 1;
+        if (sep != NULL) {
+            *sep = '\0';
+            threads = atoi(sep + 1);
+        }
+
+        int kind = -1;
+        for (int i = 0; i < (int) ARRAY_SIZE(kinds); i++) {
+            if (!strcmp(item, kinds[i])) {
+                kind = i;
+            }
+        }
+
+        if (kind < 0 || threads < 1 || count + threads > MAX_STRESSORS) {
+            free(list);
+            return -1;
+        }
+
+        for (int i = 0; i < threads; i++) {
+            stressors[count++].kind = kind;
+        }
+    }
+
+    free(list);
+    return count;
+}
+
+// Runs the benchmark on the first nr_threads CPUs concurrently and sets the aggregate calls/sec
+static int run_bench_threads(const struct bench_def *def, int calls, int loops, int rounds,
+                             int *cpus, int nr_cpus, int nr_threads, struct worker *workers, double *rate) {
+    struct spin_barrier barrier = {
+        .total = nr_threads,
+    };
+    int error = 0;
+
+    for (int i = 0; i < nr_threads; i++) {
+        workers[i] = (struct worker) {
+            .cpu = cpus[i % nr_cpus],
+            .def = def,
+            .calls = calls,
+            .loops = loops,
+            .rounds = rounds,
+            .barrier = &barrier,
+        };
+
+        int ret = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+        if (ret != 0) {
+            fprintf(stderr, "failed to create worker thread: %s\n", strerror(ret));
+            barrier_abandon(&barrier, nr_threads - i);
+            nr_threads = i;
+            error = -ret;
+            break;
+        }
+    }
+
+    double total_rate = 0;
+    for (int i = 0; i < nr_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        // Workers skip timing if any failed to start, leaving ns at 0
+        if (workers[i].error == 0 && workers[i].ns > 0) {
+            total_rate += NS_PER_SEC / workers[i].ns;
+        }
+        if (error == 0) {
+            error = workers[i].error;
+        }
+    }
+
+    *rate = total_rate;
+    return error;
+}
+
+static void format_size(long size, char *buf, int len) {
+    if (size >= (1L << 30) && size % (1L << 30) == 0) {
+        snprintf(buf, len, "%ldG", size >> 30);
+    } else if (size >= (1L << 20) && size % (1L << 20) == 0) {
+        snprintf(buf, len, "%ldM", size >> 20);
+    } else if (size >= (1L << 10) && size % (1L << 10) == 0) {
+        snprintf(buf, len, "%ldK", size >> 10);
+    } else {
+        snprintf(buf, len, "%ld", size);
+    }
+}
+
+static void format_run_label(struct bench_run *run, char *buf, int len) {
+    int pos = snprintf(buf, len, "%s", run->def->name);
+
+    if (run->size && pos < len) {
+        char size[32];
+        format_size(run->size, size, sizeof(size));
+        pos += snprintf(buf + pos, len - pos, " %s", size);
+    }
+
+    if (run->batch && pos < len) {
+        pos += snprintf(buf + pos, len - pos, " x%d", run->batch);
+    }
+
+    if (run->spec_ctrl >= 0 && pos < len) {
+        snprintf(buf + pos, len - pos, " [%s]", spec_ctrls[run->spec_ctrl].name);
+    }
+}
+
+// Prints a scaling curve for 1, 2, 4, ... threads up to the requested count
+static int bench_scaling(struct bench_run *run, struct options *opts) {
+    static int cpus[MAX_THREADS];
+    static struct worker workers[MAX_THREADS];
+
+    static bool warned = 0;
+
+    int nr_cpus = get_cpus(cpus, MAX_THREADS);
+    if (opts->threads > nr_cpus && !warned) {
+        fprintf(stderr, "warning: %d threads share %d CPUs\n", opts->threads, nr_cpus);
+        warned = 1;
+    }
+
+    if (cb_output_format == FORMAT_TEXT) {
+        char label[64];
+        format_run_label(run, label, sizeof(label));
+        printf("    %s:\toverhead %.2f ns\n", label, run->overhead_ns);
+    }
+
+    double base_rate = 0;
+    for (int nr_threads = 1;; nr_threads *= 2) {
+        if (nr_threads > opts->threads) {
+            nr_threads = opts->threads;
+        }
+
+        sample_buf_free(&handoff_samples);
+        handoff_samples = (struct sample_buf) { 0 };
+
+        progress = 0;
+        double rate;
+        int ret = run_bench_threads(run->def, run->calls, run->loops, run->rounds,
+            cpus, nr_cpus, nr_threads, workers, &rate);
+        progress = 1;
+        if (ret != 0) {
+            return ret;
+        }
+
+        struct bench_stats handoff = { .count = 0 };
+        if (run->def->flags & BENCH_HANDOFF) {
+            compute_stats(&handoff_samples, 0, &handoff);
+        }
+
+        if (nr_threads == 1) {
+            base_rate = rate;
+        }
+
+        // Raw per-call times, as throughput includes the harness overhead like single-thread runs do
+        double min_ns = HUGE_VAL, max_ns = 0, sum_ns = 0;
+        for (int i = 0; i < nr_threads; i++) {
+            min_ns = fmin(min_ns, workers[i].ns);
+            max_ns = fmax(max_ns, workers[i].ns);
+            sum_ns += workers[i].ns;
+        }
+
+        if (cb_output_format != FORMAT_TEXT) {
+            struct bench_run thread_run = *run;
+            thread_run.threads = nr_threads;
+            thread_run.calls_per_sec = rate;
+            thread_run.result.raw_ns = sum_ns / nr_threads;
+            thread_run.result.ns = fmax(sum_ns / nr_threads - run->overhead_ns, 0);
+            thread_run.handoff = handoff;
+
+            report_record(&thread_run);
+        } else {
+            printf("\t%4d threads:\t%10.3f M calls/s\tscaling %6.2fx\tper-thread %.2f-%.2f ns (%.3f-%.3f M calls/s)",
+                nr_threads, rate / 1e6, rate / base_rate, fmax(min_ns - run->overhead_ns, 0),
+                fmax(max_ns - run->overhead_ns, 0), NS_PER_SEC / max_ns / 1e6, NS_PER_SEC / min_ns / 1e6);
+            if (run->size) {
+                printf("\t%.2f GB/s", rate * run->size * run_ops(run) / NS_PER_SEC);
+            }
+            putchar('\n');
+            if (handoff.count > 0) {
+                printf("\t\thandoff p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f ns  (%ld handoffs)\n",
+                    handoff.p50, handoff.p90, handoff.p99, handoff.p999, handoff.max, handoff.count);
+            }
+            fflush(stdout);
+        }
+
+        if (nr_threads == opts->threads) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static void print_compare(struct bench_compare *cmp) {
+    const char *verdict = cmp->regression ? "REGRESSION" : cmp->p >= COMPARE_ALPHA ? "no significant change" :
+        cmp->delta < 0 ? "faster" : "slower within threshold";
+    printf("\t\tvs baseline median %.2f ns: %+.2f%% (p=%.3g) %s\n",
+        cmp->base_median, cmp->delta * 100, cmp->p, verdict);
+}
+
+static void print_summary(struct bench_summary *summary) {
+    printf("\t\tmedian %.2f ns (95%% CI %.2f-%.2f, +/-%.2f%%)  mean %.2f  stddev %.2f ns  %ld/%ld outliers  %d rounds%s\n",
+        summary->median, summary->ci_lo, summary->ci_hi,
+        summary->median > 0 ? (summary->ci_hi - summary->ci_lo) / 2 / summary->median * 100 : 0,
+        summary->mean, summary->stddev, summary->outliers, summary->count, summary->rounds,
+        summary->converged ? "" : " (budget expired)");
+}
+
+static void report_result(struct bench_run *run, struct options *opts) {
+    if (cb_output_format != FORMAT_TEXT) {
+        report_record(run);
+        return;
+    }
+
+    char label[64];
+    format_run_label(run, label, sizeof(label));
+
+    struct bench_result *result = &run->result;
+    printf("    %s:\t%.2f ns\t(raw %.2f ns)", label, result->ns, result->raw_ns);
+    if (run->batch) {
+        printf("\t%.2f ns/op\t%.3f M ops/s", result->ns / run->batch, run->calls_per_sec * run->batch / 1e6);
+    }
+    if (run->size) {
+        printf("\t%.2f GB/s", run->size * run_ops(run) * run->calls_per_sec / NS_PER_SEC);
+    }
+    if (run_pages(run)) {
+        printf("\t%.2f ns/page", result->ns / run_pages(run));
+    }
+    if (run->vdso_fallback == 1) {
+        printf("\tsyscall fallback (no faster than %s)", run->def->syscall_ref);
+    }
+    if (run->spec_base_ns > 0) {
+        printf("\t%+.2f ns (%+.1f%%) vs without", result->ns - run->spec_base_ns,
+            (result->ns / run->spec_base_ns - 1) * 100);
+    }
+    putchar('\n');
+
+    if (run->inlined) {
+        printf("\t\tinlined x%d: %.2f ns\t(raw %.2f ns)\tdispatch cost %+.2f ns\n",
+            opts->unroll, run->inline_ns, run->inline_raw_ns, result->raw_ns - run->inline_raw_ns);
+    } else if (opts->unroll) {
+        // Records leave the inline_* fields empty instead
+        printf("\t\tinlined: no specialized loop\n");
+    }
+    if (run->compare.valid)
+        print_compare(&run->compare);
+    if (opts->adaptive)
+        print_summary(&result->summary);
+    if (opts->dist)
+        print_stats(&result->stats);
+    if (opts->perf)
+        print_perf(result);
+}
+
+static void report_unsupported(struct bench_run *run) {
+    if (cb_output_format == FORMAT_TEXT) {
+        char label[64];
+        format_run_label(run, label, sizeof(label));
+        printf("    %s:\t<unsupported>\n", label);
+    }
+}
+
+static int default_arg(int arg, int def) {
+    return arg == -1 ? def : arg;
+}
+
+static int bench_setup(const struct bench_def *def, struct options *opts) {
+    if (def->impl == NULL || (opts->threads && def->flags & BENCH_NO_THREADS)) {
+        return -1;
+    }
+
+    return def->setup ? def->setup(def) : 0;
+}
+
+static void bench_teardown(const struct bench_def *def) {
+    if (def->teardown) {
+        def->teardown(def);
+    }
+}
+
+// Large transfers and batches get fewer calls per loop so each loop does about as much work as the default
+static int default_calls(const struct bench_def *def, struct bench_run *run) {
+    long calls = def->calls / run_ops(run);
+
+    if (run->size > TEST_READ_LEN) {
+        calls = calls * TEST_READ_LEN / run->size;
+    }
+
+    return calls < 1 ? 1 : calls;
+}
+
+// Returns the transfer sizes a benchmark runs at, or a single unused size if it isn't sized
+static long *run_sizes(const struct bench_def *def, int *nr_sizes) {
+    if (!(def->flags & BENCH_SIZED)) {
+        *nr_sizes = 1;
+        return cb_xfer_sizes;
+    }
+    if (def->flags & BENCH_CACHE_SWEEP && !cb_xfer_sizes_set) {
+        *nr_sizes = sizeof(cache_sweep_sizes) / sizeof(cache_sweep_sizes[0]);
+        return cache_sweep_sizes;
+    }
+
+    *nr_sizes = cb_nr_xfer_sizes;
+    return cb_xfer_sizes;
+}
+
+// Expands the selected benchmarks of a group into one run per transfer size
+static int plan_group(const struct bench_group *group, struct options *opts, struct bench_run **runs_out) {
+    int count = 0;
+    for (int i = 0; i < NR_BENCHMARKS; i++) {
+        if (selected[i] && !strcmp(benchmarks[i].group, group->name)) {
+            int nr_sizes;
+            run_sizes(&benchmarks[i], &nr_sizes);
+            count += nr_sizes * (opts->spec_ctrl ? 1 + NR_SPEC_CTRLS : 1) *
+                (benchmarks[i].flags & BENCH_BATCHED ? cb_nr_batch_sizes : 1);
+        }
+    }
+
+    struct bench_run *runs = calloc(count, sizeof(*runs));
+    if (runs == NULL && count > 0) {
+        fprintf(stderr, "failed to allocate benchmark runs\n");
+        return -ENOMEM;
+    }
+
+    int n = 0;
+    for (int i = 0; i < NR_BENCHMARKS; i++) {
+        const struct bench_def *def = &benchmarks[i];
+        if (!selected[i] || strcmp(def->group, group->name)) {
+            continue;
+        }
+
+        int nr_sizes;
+        long *sizes = run_sizes(def, &nr_sizes);
+        int nr_batches = def->flags & BENCH_BATCHED ? cb_nr_batch_sizes : 1;
+        for (int s = 0; s < nr_sizes; s++) {
+            for (int b = 0; b < nr_batches; b++) {
+                struct bench_run *run = &runs[n++];
+                run->def = def;
+                run->size = def->flags & BENCH_SIZED ? sizes[s] : 0;
+                run->batch = def->flags & BENCH_BATCHED ? cb_batch_sizes[b] : 0;
+                run->calls = default_arg(opts->calls, default_calls(def, run));
+                run->loops = default_arg(opts->loops, def->loops);
+                run->rounds = default_arg(opts->rounds, def->rounds);
+                run->threads = 1;
+                run->vdso_fallback = -1;
+                run->cpu_node = -1;
+                run->mem_node = -1;
+                run->spec_ctrl = -1;
+
+                // Each control reruns the benchmark right after the run it's compared against
+                for (int c = 0; opts->spec_ctrl && c < NR_SPEC_CTRLS; c++) {
+                    runs[n] = *run;
+                    runs[n++].spec_ctrl = c;
+                }
+            }
+        }
+    }
+
+    *runs_out = runs;
+    return count;
+}
+
+// Flags vDSO calls that are about as slow as their direct syscalls, e.g. with an hpet clocksource
+static void check_vdso_fallback(struct bench_run *runs, int nr_runs) {
+    for (int i = 0; i < nr_runs; i++) {
+        struct bench_run *run = &runs[i];
+        if (!run->supported || run->def->syscall_ref == NULL) {
+            continue;
+        }
+
+        for (int j = 0; j < nr_runs; j++) {
+            struct bench_run *ref = &runs[j];
+            if (ref->supported && ref->spec_ctrl == run->spec_ctrl && !strcmp(ref->def->name, run->def->syscall_ref)) {
+                run->vdso_fallback = run->result.ns >= ref->result.ns * VDSO_FALLBACK_RATIO;
+                break;
+            }
+        }
+    }
+}
+
+// Identifies a run across invocations, e.g. "file.pread 65536 0"
+static void format_run_key(struct bench_run *run, char *buf, int len) {
+    snprintf(buf, len, "%s.%s %ld %d", run->def->group, run->def->name, run->size, run->batch);
+}
+
+// Loads the sample distributions written by --save-baseline, one run per line
+int cb_load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "failed to open baseline %s: %s\n", path, strerror(errno));
+        return -errno;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, f) > 0) {
+        char name[256];
+        long size, count;
+        int batch, pos;
+        if (line[0] == '#' || sscanf(line, "%255s %ld %d %ld%n", name, &size, &batch, &count, &pos) != 4 ||
+                count <= 0) {
+            continue;
+        }
+
+        struct baseline_entry *entries = realloc(baseline, (nr_baseline + 1) * sizeof(*entries));
+        if (entries != NULL) {
+            baseline = entries;
+        }
+
+        double *ns = malloc(count * sizeof(*ns));
+        if (entries == NULL || ns == NULL) {
+            fprintf(stderr, "failed to allocate baseline\n");
+            free(ns);
+            free(line);
+            fclose(f);
+            return -ENOMEM;
+        }
+
+        struct baseline_entry *entry = &baseline[nr_baseline++];
+        snprintf(entry->key, sizeof(entry->key), "%s %ld %d", name, size, batch);
+        entry->samples.ns = ns;
+        entry->samples.len = 0;
+        entry->samples.cap = count;
+
+        char *p = line + pos;
+        for (long i = 0; i < count; i++) {
+            char *end;
+            double val = strtod(p, &end);
+            if (end == p) {
+                break;
+            }
+
+            sample_add(&entry->samples, val);
+            p = end;
+        }
+
+        qsort(ns, entry->samples.len, sizeof(*ns), cmp_double);
+    }
+
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+static void save_baseline_run(struct bench_run *run) {
+    char key[BASELINE_KEY_LEN];
+    format_run_key(run, key, sizeof(key));
+
+    fprintf(cb_baseline_out, "%s %ld", key, run->samples.len);
+    for (long i = 0; i < run->samples.len; i++) {
+        fprintf(cb_baseline_out, " %.3f", run->samples.ns[i]);
+    }
+    fputc('\n', cb_baseline_out);
+}
+
+// Two-sided Mann-Whitney U test on sorted samples, using the normal approximation with tie correction
+static double mann_whitney_p(const double *a, long n1, const double *b, long n2) {
+    double rank_sum = 0, tie_sum = 0;
+    long i = 0, j = 0;
+
+    while (i < n1 || j < n2) {
+        double val = j >= n2 || (i < n1 && a[i] <= b[j]) ? a[i] : b[j];
+        long ties_a = 0, ties_b = 0;
+        while (i < n1 && a[i] == val) {
+            ties_a++;
+            i++;
+        }
+        while (j < n2 && b[j] == val) {
+            ties_b++;
+            j++;
+        }
+
+        // Tied values share the mean of the ranks they span
+        long first_rank = i + j - ties_a - ties_b + 1;
+        long ties = ties_a + ties_b;
+        rank_sum += ties_a * (first_rank + (ties - 1) / 2.0);
+        tie_sum += (double) ties * ties * ties - ties;
+    }
+
+    double n = n1 + n2;
+    double u = rank_sum - n1 * (n1 + 1) / 2.0;
+    double mean = n1 * (double) n2 / 2;
+    double var = n1 * (double) n2 / 12 * ((n + 1) - tie_sum / (n * (n - 1)));
+    if (var <= 0) {
+        return 1;
+    }
+
+    return erfc(fabs(u - mean) / sqrt(var) / M_SQRT2);
+}
+
+// Compares a run's samples with the baseline and flags significant slowdowns past the threshold
+static void compare_run(struct bench_run *run, struct options *opts) {
+    char key[BASELINE_KEY_LEN];
+    format_run_key(run, key, sizeof(key));
+
+    for (int i = 0; i < nr_baseline; i++) {
+        struct sample_buf *base = &baseline[i].samples;
+        if (strcmp(baseline[i].key, key) || base->len < 2 || run->samples.len < 2) {
+            continue;
+        }
+
+        struct bench_compare *cmp = &run->compare;
+        cmp->valid = 1;
+        cmp->base_median = percentile(base->ns, base->len, 50);
+        double median = percentile(run->samples.ns, run->samples.len, 50);
+        cmp->delta = cmp->base_median > 0 ? median / cmp->base_median - 1 : 0;
+        cmp->p = mann_whitney_p(run->samples.ns, run->samples.len, base->ns, base->len);
+        cmp->regression = cmp->p < COMPARE_ALPHA && cmp->delta > opts->threshold;
+        cb_regressed = cb_regressed || cmp->regression;
+        return;
+    }
+}
+
+static void report_soak_interval(struct bench_run *run, struct sample_buf *samples, double overhead_ns,
+                                 double elapsed_s, double calls_per_sec) {
+    struct bench_stats stats;
+    compute_stats(samples, overhead_ns, &stats);
+
+    struct cpu_state cpu;
+    get_cpu_state(&cpu);
+
+    if (cb_output_format == FORMAT_TEXT) {
+        char label[64];
+        format_run_label(run, label, sizeof(label));
+        printf("    %s:\t%8.2f s\t%10.3f M calls/s\tp50 %.1f  p90 %.1f  p99 %.1f  max %.1f ns",
+            label, elapsed_s, calls_per_sec / 1e6, stats.p50, stats.p90, stats.p99, stats.max);
+        if (cpu.mhz > 0) {
+            printf("\t%.0f MHz", cpu.mhz);
+        }
+        putchar('\n');
+        fflush(stdout);
+        return;
+    }
+
+    struct record rec = { .len = 0 };
+    record_add_str(&rec, "group", run->def->group);
+    record_add_str(&rec, "name", run->def->name);
+    if (run->size)
+        record_add(&rec, "size_bytes", "%ld", run->size);
+    else
+        record_add(&rec, "size_bytes", "");
+    record_add(&rec, "ops_per_call", "%d", run_ops(run));
+    // Wall clock time to line intervals up with host logs and metrics
+    record_add(&rec, "timestamp_ns", "%ld", clock_ns(CLOCK_REALTIME));
+    record_add_num(&rec, "elapsed_sec", elapsed_s, 1);
+    record_add_num(&rec, "calls_per_sec", calls_per_sec, 1);
+    record_add(&rec, "samples", "%ld", stats.count);
+    record_add_num(&rec, "min_ns", stats.min, 1);
+    record_add_num(&rec, "p50_ns", stats.p50, 1);
+    record_add_num(&rec, "p90_ns", stats.p90, 1);
+    record_add_num(&rec, "p99_ns", stats.p99, 1);
+    record_add_num(&rec, "p999_ns", stats.p999, 1);
+    record_add_num(&rec, "max_ns", stats.max, 1);
+    record_add(&rec, "cpu", "%d", cpu.cpu);
+    record_add_num(&rec, "cpu_mhz", cpu.mhz, cpu.mhz > 0);
+    record_emit(&rec);
+}
+
+// Runs a benchmark continuously for --duration, reporting throughput and latency every --interval
+static int run_soak(struct bench_run *run, struct options *opts) {
+    struct sample_buf samples;
+    int ret = alloc_samples(&samples, run->calls, run->loops, 1, opts);
+    if (ret != 0) {
+        return ret;
+    }
+
+    progress = 0;
+    double overhead_ns;
+    ret = measure_overhead(run->calls, run->loops, opts, &overhead_ns);
+    progress = 1;
+    if (ret != 0) {
+        sample_buf_free(&samples);
+        return ret;
+    }
+
+    long interval_ns = (long) (opts->interval_ms * NS_PER_MS);
+    spin_warmup(cb_warmup_ms);
+
+    long start_ns = clock_ns(CLOCK_MONOTONIC);
+    long end_ns = start_ns + (long) (opts->duration_s * NS_PER_SEC);
+    long interval_start_ns = start_ns;
+    long interval_calls = 0;
+
+    for (;;) {
+        time_loop(run->def->impl, run->calls, &samples);
+        interval_calls += run->calls;
+
+        long now_ns = clock_ns(CLOCK_MONOTONIC);
+        if (now_ns - interval_start_ns >= interval_ns || now_ns >= end_ns) {
+            double calls_per_sec = (double) interval_calls * NS_PER_SEC / (now_ns - interval_start_ns);
+            report_soak_interval(run, &samples, overhead_ns, (double) (now_ns - start_ns) / NS_PER_SEC,
+                calls_per_sec);
+
+            samples.len = 0;
+            interval_calls = 0;
+            interval_start_ns = clock_ns(CLOCK_MONOTONIC);
+            if (now_ns >= end_ns) {
+                break;
+            }
+        }
+    }
+
+    sample_buf_free(&samples);
+    return 0;
+}
+
+// Sets up, runs and tears down one benchmark on the calling thread, returning a negative errno
+// if it failed for want of memory or threads rather than being unsupported
+static int measure_run(struct bench_run *run, struct options *opts, struct overhead_cache *overhead) {
+    int ret = 0;
+
+    trace_def = run->def;
+    run->supported = bench_setup(run->def, opts) == 0;
+    if (!run->supported) {
+        if (opts->threads)
+            report_unsupported(run);
+        return 0;
+    }
+
+    if (opts->adaptive && opts->calls == -1) {
+        run->calls = calibrate_calls(run->def->impl, opts->loop_ms * NS_PER_MS);
+    }
+
+    // Soak measures its own overhead; thread workers run the same loop shape as this thread
+    if (opts->duration_s <= 0 && (run->calls != overhead->calls || run->loops != overhead->loops)) {
+        bool saved_progress = progress;
+        progress = saved_progress && !opts->threads; // scaling rows print no dots
+        ret = measure_overhead(run->calls, run->loops, opts, &overhead->ns);
+        progress = saved_progress;
+
+        overhead->calls = ret == 0 ? run->calls : -1;
+        overhead->loops = ret == 0 ? run->loops : -1;
+    }
+    run->overhead_ns = overhead->ns;
+
+    if (ret == 0 && opts->duration_s > 0) {
+        ret = run_soak(run, opts);
+    } else if (ret == 0 && opts->threads) {
+        ret = bench_scaling(run, opts);
+    } else if (ret == 0) {
+        ret = run_bench(run, opts);
+        if (ret == 0 && opts->unroll && run->def->inlined != NULL) {
+            run_inlined(run, opts);
+        }
+        run->calls_per_sec = NS_PER_SEC / run->result.raw_ns;
+    }
+
+    bench_teardown(run->def);
+    trace_def = NULL;
+    return ret;
+}
+
+struct isolated_run {
+    struct bench_run *run;
+    struct options *opts;
+    struct overhead_cache *overhead;
+    int ret;
+};
+
+static void *isolated_main(void *arg) {
+    struct isolated_run *iso = arg;
+    if (iso->run->spec_ctrl >= 0 && apply_spec_ctrl(iso->run->spec_ctrl) != 0) {
+        return NULL;
+    }
+
+    test_read_buf = alloc_read_buf();
+    if (test_read_buf == NULL) {
+        iso->ret = -ENOMEM;
+        return NULL;
+    }
+
+    iso->ret = measure_run(iso->run, iso->opts, iso->overhead);
+    free(test_read_buf);
+    return NULL;
+}
+
+// Runs a benchmark on a new thread, inheriting this one's affinity and scheduling, so per-thread
+// state its setup installs (such as a seccomp filter or speculation control) is discarded with the thread
+static int measure_isolated(struct bench_run *run, struct options *opts, struct overhead_cache *overhead) {
+    struct isolated_run iso = { run, opts, overhead, 0 };
+    pthread_t thread;
+
+    int ret = pthread_create(&thread, NULL, isolated_main, &iso);
+    if (ret != 0) {
+        fprintf(stderr, "failed to create thread for %s: %s\n", run->def->name, strerror(ret));
+        return -ret;
+    }
+
+    pthread_join(thread, NULL);
+    return iso.ret;
+}
+
+struct numa_cell {
+    struct bench_run run;
+    struct options *opts;
+    struct overhead_cache *overhead;
+    int ret;
+};
+
+// Measures a run pinned to its CPU node with all of its memory on its memory node
+static void *numa_main(void *arg) {
+    struct numa_cell *cell = arg;
+    struct bench_run *run = &cell->run;
+
+    if (pin_thread(numa_nodes[run->cpu_node].cpu) != 0 || bind_mempolicy(numa_nodes[run->mem_node].node) != 0) {
+        return NULL;
+    }
+
+    test_read_buf = alloc_read_buf();
+    if (test_read_buf == NULL) {
+        cell->ret = -ENOMEM;
+        return NULL;
+    }
+
+    bind_memory(test_read_buf, read_buf_size, numa_nodes[run->mem_node].node);
+    cell->ret = measure_run(run, cell->opts, cell->overhead);
+    free(test_read_buf);
+    return NULL;
+}
+
+static void print_numa_cell(struct bench_run *run) {
+    if (!run->supported) {
+        printf("\t<unsupported>");
+        return;
+    }
+
+    printf("\t%.2f ns", run->result.ns);
+    if (run->size) {
+        printf(" %.2f GB/s", run->size * run_ops(run) * run->calls_per_sec / NS_PER_SEC);
+    }
+}
+
+// Runs a benchmark for every pair of CPU node and memory node and prints them as a matrix
+static int measure_numa(struct bench_run *run, struct options *opts, struct overhead_cache *overhead) {
+    int nr_cells = nr_numa_nodes * nr_numa_nodes;
+    struct numa_cell *cells = calloc(nr_cells, sizeof(*cells));
+    if (cells == NULL) {
+        fprintf(stderr, "failed to allocate NUMA matrix\n");
+        return -ENOMEM;
+    }
+
+    int ret = 0;
+    progress = 0;
+    for (int c = 0; c < nr_numa_nodes && ret == 0; c++) {
+        for (int m = 0; m < nr_numa_nodes; m++) {
+            struct numa_cell *cell = &cells[c * nr_numa_nodes + m];
+            cell->run = *run;
+            cell->run.cpu_node = c;
+            cell->run.mem_node = m;
+            cell->opts = opts;
+            cell->overhead = overhead;
+            if (numa_nodes[c].cpu == -1) {
+                continue;
+            }
+
+            pthread_t thread;
+            ret = pthread_create(&thread, NULL, numa_main, cell);
+            if (ret != 0) {
+                fprintf(stderr, "failed to create thread for %s: %s\n", run->def->name, strerror(ret));
+                ret = -ret;
+                break;
+            }
+            pthread_join(thread, NULL);
+
+            ret = cell->ret;
+            if (ret != 0) {
+                break;
+            }
+        }
+    }
+    progress = 1;
+
+    if (ret != 0) {
+        for (int i = 0; i < nr_cells; i++) {
+            sample_buf_free(&cells[i].run.samples);
+        }
+        free(cells);
+        return ret;
+    }
+
+    if (cb_output_format == FORMAT_TEXT) {
+        char label[64];
+        format_run_label(run, label, sizeof(label));
+        printf("    %s:\n\tcpu\\mem", label);
+        for (int m = 0; m < nr_numa_nodes; m++) {
+            printf("\tnode %d", numa_nodes[m].node);
+        }
+        putchar('\n');
+    }
+
+    for (int c = 0; c < nr_numa_nodes; c++) {
+        if (numa_nodes[c].cpu == -1) {
+            continue;
+        }
+
+        if (cb_output_format == FORMAT_TEXT) {
+            printf("\tnode %d", numa_nodes[c].node);
+        }
+        for (int m = 0; m < nr_numa_nodes; m++) {
+            struct bench_run *cell = &cells[c * nr_numa_nodes + m].run;
+            if (cb_output_format == FORMAT_TEXT) {
+                print_numa_cell(cell);
+            } else if (cell->supported) {
+                report_record(cell);
+            }
+            sample_buf_free(&cell->samples);
+        }
+        if (cb_output_format == FORMAT_TEXT) {
+            putchar('\n');
+        }
+    }
+    fflush(stdout);
+
+    free(cells);
+    return 0;
+}
+
+// Runs the selected benchmarks of a group, returning a negative errno if one couldn't be run
+static int run_group(const struct bench_group *group, struct options *opts) {
+    static bool ran_group = 0;
+    struct bench_run *runs;
+    int nr_runs = plan_group(group, opts, &runs);
+    if (nr_runs <= 0) {
+        if (nr_runs == 0)
+            free(runs);
+        return nr_runs;
+    }
+
+    if (cb_output_format == FORMAT_TEXT) {
+        if (ran_group) {
+            putchar('\n');
+        }
+        ran_group = 1;
+
+        if (opts->threads) {
+            printf("%s (%d threads):\n", group->title, opts->threads);
+        } else if (opts->numa) {
+            printf("%s (cpu node x memory node):\n", group->title);
+        } else if (opts->duration_s > 0) {
+            printf("%s (%.0f ms intervals):\n", group->title, opts->interval_ms);
+        } else {
+            printf("%s: ", group->title);
+        }
+        fflush(stdout);
+    }
+
+    // Overhead depends only on the loop shape, so reuse it between benchmarks
+    struct overhead_cache overhead = { .calls = -1, .loops = -1 };
+    int ret = 0;
+
+    for (int i = 0; i < nr_runs && ret == 0; i++) {
+        struct bench_run *run = &runs[i];
+        if (run->size) {
+            xfer_size = run->size;
+        }
+        if (run->batch) {
+            batch_size = run->batch;
+        }
+
+        if (opts->numa) {
+            ret = measure_numa(run, opts, &overhead);
+        } else if (run->def->flags & BENCH_ISOLATED || run->spec_ctrl >= 0) {
+            ret = measure_isolated(run, opts, &overhead);
+        } else {
+            ret = measure_run(run, opts, &overhead);
+        }
+    }
+
+    if (ret == 0 && !opts->threads && !opts->duration_s && !opts->numa) {
+        if (cb_output_format == FORMAT_TEXT) {
+            putchar('\n');
+        }
+
+        check_vdso_fallback(runs, nr_runs);
+        struct bench_run *base = NULL;
+        for (int i = 0; i < nr_runs; i++) {
+            if (runs[i].spec_ctrl == -1) {
+                base = &runs[i];
+            } else if (base->supported) {
+                runs[i].spec_base_ns = base->result.ns;
+            }
+        }
+
+        for (int i = 0; i < nr_runs; i++) {
+            if (!runs[i].supported) {
+                continue;
+            }
+
+            if (cb_baseline_out != NULL)
+                save_baseline_run(&runs[i]);
+            if (baseline != NULL)
+                compare_run(&runs[i], opts);
+        }
+
+        double printed_overhead = -1;
+        for (int i = 0; i < nr_runs; i++) {
+            struct bench_run *run = &runs[i];
+
+            if (!run->supported) {
+                report_unsupported(run);
+                continue;
+            }
+
+            if (cb_output_format == FORMAT_TEXT && run->overhead_ns != printed_overhead) {
+                printf("    overhead:\t%.2f ns\n", run->overhead_ns);
+                printed_overhead = run->overhead_ns;
+            }
+
+            report_result(run, opts);
+        }
+
+        print_cpu_state();
+    }
+
+    for (int i = 0; i < nr_runs; i++) {
+        sample_buf_free(&runs[i].samples);
+    }
+    free(runs);
+    return ret;
+}
+
+// Runs the selected benchmarks of every group in order
+int cb_run_groups(struct options *opts) {
+    for (int i = 0; i < NR_BENCH_GROUPS; i++) {
+        int ret = run_group(&bench_groups[i], opts);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+// Parses a size with an optional K, M or G suffix
+long cb_parse_size(const char *str, char **end) {
+    long size = strtol(str, end, 10);
+
+    switch (**end) {
+    case 'k':
+    case 'K':
+        size <<= 10;
+        (*end)++;
+        break;
+    case 'm':
+    case 'M':
+        size <<= 20;
+        (*end)++;
+        break;
+    case 'g':
+    case 'G':
+        size <<= 30;
+        (*end)++;
+        break;
+    }
+
+    return size;
+}
+
+// Parses a list such as "4K,1M" or "4K-16M", where ranges step by powers of two
+int cb_parse_size_list(const char *list, long *sizes, int max) {
+    int count = 0;
+    const char *p = list;
+
+    while (*p) {
+        char *end;
+        long first = cb_parse_size(p, &end);
+        if (end == p || first <= 0) {
+            return -1;
+        }
+
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = cb_parse_size(p, &end);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+
+        for (long size = first; size <= last; size *= 2) {
+            if (count == max) {
+                return -1;
+            }
+
+            sizes[count++] = size;
+        }
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+
+        p = end;
+    }
+
+    return count;
+}
+
+// Sizes transfer buffers for the largest transfer and allocates the main thread's
+int cb_init_buffers(void) {
+    for (int i = 0; i < cb_nr_xfer_sizes; i++) {
+        if (cb_xfer_sizes[i] > read_buf_size) {
+            read_buf_size = cb_xfer_sizes[i];
+        }
+    }
+
+    page_size = sysconf(_SC_PAGESIZE);
+    test_read_buf = alloc_read_buf();
+    if (test_read_buf == NULL) {
+        return -ENOMEM;
+    }
+
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    // Keep the defaults where glibc can't tell, e.g. on most non-x86 CPUs
+    long caches[3] = {
+        sysconf(_SC_LEVEL1_DCACHE_SIZE),
+        sysconf(_SC_LEVEL2_CACHE_SIZE),
+        sysconf(_SC_LEVEL3_CACHE_SIZE),
+    };
+    for (int i = 0; i < 3; i++) {
+        if (caches[i] >= 2 * page_size) {
+            cache_sweep_sizes[i] = caches[i] / 2 / page_size * page_size;
+        }
+    }
+    if (caches[2] > 0 && caches[2] * 2 > cache_sweep_sizes[3]) {
+        cache_sweep_sizes[3] = caches[2] * 2;
+    }
+#endif
+
+    return 0;
+}
+
+// Selects benchmarks by group, name or group.name, each of which may be a glob
+int cb_select_benchmarks(const char *mode) {
+    char *list = strdup(mode);
+    int matched_all = 1;
+
+    for (char *pattern = strtok(list, ","); pattern != NULL; pattern = strtok(NULL, ",")) {
+        int matched = 0;
+
+        for (int i = 0; i < NR_BENCHMARKS; i++) {
+            const struct bench_def *def = &benchmarks[i];
+            char full_name[128];
+            snprintf(full_name, sizeof(full_name), "%s.%s", def->group, def->name);
+
+            if (!strcmp(pattern, "all") || !fnmatch(pattern, def->group, 0) ||
+                    !fnmatch(pattern, def->name, 0) || !fnmatch(pattern, full_name, 0)) {
+                selected[i] = 1;
+                matched = 1;
+            }
+        }
+
+        if (!matched) {
+            fprintf(stderr, "no benchmarks match '%s'\n", pattern);
+            matched_all = 0;
+        }
+    }
+
+    free(list);
+    return matched_all ? 0 : -1;
+}
+
+void cb_list_benchmarks(void) {
+    for (int g = 0; g < NR_BENCH_GROUPS; g++) {
+        printf("%s (%s):\n", bench_groups[g].name, bench_groups[g].title);
+
+        for (int i = 0; i < NR_BENCHMARKS; i++) {
+            const struct bench_def *def = &benchmarks[i];
+            if (strcmp(def->group, bench_groups[g].name)) {
+                continue;
+            }
+
+            printf("    %-12s %s%s (calls %d, loops %d, rounds %d)\n", def->name,
+                def->impl ? "" : "[unsupported] ", def->desc, def->calls, def->loops, def->rounds);
+        }
+    }
+}
+
+static int open_trace_marker(void) {
+    int fd = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        // tracefs is only under debugfs before Linux 4.1
+        fd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+    }
+
+    return fd;
+}
+
+// Maps a --trace-ring file big enough for TRACE_RING_LEN entries and the name of every benchmark
+static int map_trace_ring(void) {
+    long names_len = 0;
+    for (int i = 0; i < NR_BENCHMARKS; i++) {
+        names_len += strlen(benchmarks[i].group) + strlen(benchmarks[i].name) + 2;
+    }
+
+    long names_off = sizeof(*trace_ring) + TRACE_RING_LEN * sizeof(*trace_entries);
+    long size = names_off + names_len;
+
+    int fd = open(cb_trace_ring_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        int err = errno;
+        fprintf(stderr, "failed to create trace ring %s: %s\n", cb_trace_ring_path, strerror(err));
+        if (fd >= 0)
+            close(fd);
+        return -err;
+    }
+
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "failed to map trace ring %s: %s\n", cb_trace_ring_path, strerror(err));
+        return -err;
+    }
+
+    trace_ring = (struct trace_ring_header *) map;
+    trace_entries = (struct trace_ring_entry *) (map + sizeof(*trace_ring));
+    *trace_ring = (struct trace_ring_header) {
+        .magic = TRACE_RING_MAGIC,
+        .version = TRACE_RING_VERSION,
+        .timer = timer_type,
+        .ns_per_tick = timer_type == TIMER_CYCLES ? cb_timer_ns_per_tick : 1,
+        .len = TRACE_RING_LEN,
+        .names_off = names_off,
+        .names_len = names_len,
+    };
+
+    char *name = map + names_off;
+    for (int i = 0; i < NR_BENCHMARKS; i++) {
+        name += sprintf(name, "%s.%s", benchmarks[i].group, benchmarks[i].name) + 1;
+    }
+
+    return 0;
+}
+
+// Needs the timer to be calibrated first, as the ring records its scale
+int cb_init_trace(void) {
+    if (cb_trace_threshold_ns > 0) {
+        trace_marker_fd = open_trace_marker();
+        if (trace_marker_fd < 0) {
+            fprintf(stderr, "failed to open trace_marker: %s\n", strerror(errno));
+            return -errno;
+        }
+    }
+
+    if (cb_trace_ring_path != NULL) {
+        int ret = map_trace_ring();
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    tracing = trace_marker_fd >= 0 || trace_ring != NULL;
+    return 0;
+}
+
+void cb_cleanup_trace(void) {
+    if (trace_marker_fd >= 0) {
+        fprintf(stderr, "trace: marked %ld loops slower than %.0f ns per call\n",
+            atomic_load(&trace_outliers), cb_trace_threshold_ns);
+        close(trace_marker_fd);
+    }
+
+    if (trace_ring != NULL) {
+        uint64_t head = trace_ring->head;
+        fprintf(stderr, "trace: saved %llu of %llu loops to %s\n",
+            (unsigned long long) (head < trace_ring->len ? head : trace_ring->len),
+            (unsigned long long) head, cb_trace_ring_path);
+        munmap(trace_ring, trace_ring->names_off + trace_ring->names_len);
+    }
+}
+
+static const struct bench_def *find_benchmark(const char *group, const char *name) {
+    for (int i = 0; i < NR_BENCHMARKS; i++) {
+        if (!strcmp(benchmarks[i].group, group) && !strcmp(benchmarks[i].name, name)) {
+            return &benchmarks[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Measures one run adaptively the same way the CLI does for --adaptive, without printing
+static int api_measure(const struct bench_def *def, const struct callbench_config *config,
+        struct bench_run *run) {
+    struct options opts = {
+        .calls = -1,
+        .loops = -1,
+        .rounds = -1,
+        .loop_ms = 10,
+        .budget_s = config->budget_s > 0 ? config->budget_s : 1,
+        .adaptive = config->target_error > 0 ? config->target_error : 0.01,
+    };
+    struct overhead_cache overhead = { .calls = -1, .loops = -1 };
+
+    *run = (struct bench_run) {
+        .def = def,
+        .size = def->flags & BENCH_SIZED ? (config->size > 0 ? config->size : TEST_READ_LEN) : 0,
+        .batch = def->flags & BENCH_BATCHED ? (config->batch > 0 ? config->batch : 1) : 0,
+        .loops = def->loops,
+        .rounds = def->rounds,
+        .threads = 1,
+        .vdso_fallback = -1,
+        .cpu_node = -1,
+        .mem_node = -1,
+        .spec_ctrl = -1,
+    };
+    run->calls = default_calls(def, run);
+    if (run->batch > MAX_BATCH) {
+        return -EINVAL;
+    }
+
+    // Transfers go through this thread's buffer, which the caller's thread may not have yet
+    char *saved_buf = test_read_buf;
+    long saved_size = read_buf_size;
+    if (run->size > read_buf_size) {
+        read_buf_size = run->size;
+    }
+
+    void *buf;
+    if (posix_memalign(&buf, page_size, read_buf_size) != 0) {
+        read_buf_size = saved_size;
+        return -ENOMEM;
+    }
+    memset(buf, 0, read_buf_size);
+    test_read_buf = buf;
+
+    xfer_size = run->size ? run->size : TEST_READ_LEN;
+    batch_size = run->batch ? run->batch : 1;
+
+    bool saved_progress = progress;
+    progress = 0;
+    int ret;
+    if (def->flags & BENCH_ISOLATED) {
+        ret = measure_isolated(run, &opts, &overhead);
+    } else {
+        ret = measure_run(run, &opts, &overhead);
+    }
+    progress = saved_progress;
+
+    test_read_buf = saved_buf;
+    read_buf_size = saved_size;
+    free(buf);
+    sample_buf_free(&run->samples);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return run->supported ? 0 : -ENOTSUP;
+}
+
+int callbench_init(void) {
+    static bool initialized = 0;
+    if (initialized) {
+        return 0;
+    }
+
+    page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) {
+        return -errno;
+    }
+
+    cb_init_timer(TIMER_CLOCK);
+    initialized = 1;
+    return 0;
+}
+
+int callbench_count(void) {
+    return NR_BENCHMARKS;
+}
+
+int callbench_info(int index, const char **group, const char **name, const char **desc) {
+    if (index < 0 || index >= NR_BENCHMARKS) {
+        return -ENOENT;
+    }
+
+    *group = benchmarks[index].group;
+    *name = benchmarks[index].name;
+    *desc = benchmarks[index].desc;
+    return 0;
+}
+
+int callbench_run(const char *name, const struct callbench_config *config, struct callbench_stats *stats) {
+    static const struct callbench_config default_config;
+
+    // Embedders that skip callbench_init would otherwise run with no page size or timer scale
+    int ret = callbench_init();
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (config == NULL) {
+        config = &default_config;
+    }
+
+    const char *dot = strchr(name, '.');
+    if (dot == NULL) {
+        return -ENOENT;
+    }
+
+    char group[32];
+    snprintf(group, sizeof(group), "%.*s", (int) (dot - name), name);
+    const struct bench_def *def = find_benchmark(group, dot + 1);
+    if (def == NULL) {
+        return -ENOENT;
+    }
+
+    struct bench_run run;
+    ret = api_measure(def, config, &run);
+    if (ret != 0) {
+        return ret;
+    }
+
+    struct bench_result *result = &run.result;
+    *stats = (struct callbench_stats) {
+        .ns = result->ns,
+        .raw_ns = result->raw_ns,
+        .overhead_ns = run.overhead_ns,
+        .calls_per_sec = run.calls_per_sec,
+        .min_ns = result->stats.min,
+        .p50_ns = result->stats.p50,
+        .p90_ns = result->stats.p90,
+        .p99_ns = result->stats.p99,
+        .max_ns = result->stats.max,
+        .mean_ns = result->summary.mean,
+        .stddev_ns = result->summary.stddev,
+        .median_ns = result->summary.median,
+        .ci_low_ns = result->summary.ci_lo,
+        .ci_high_ns = result->summary.ci_hi,
+        .samples = result->summary.count,
+        .outliers = result->summary.outliers,
+        .rounds = result->summary.rounds,
+        .converged = result->summary.converged,
+        .vdso_fallback = -1,
+    };
+
+    // Detecting a lost vDSO needs the matching syscall's cost too
+    const struct bench_def *ref = def->syscall_ref ? find_benchmark(def->group, def->syscall_ref) : NULL;
+    struct bench_run ref_run;
+    if (ref != NULL && api_measure(ref, config, &ref_run) == 0) {
+        stats->vdso_fallback = result->ns >= ref_run.result.ns * VDSO_FALLBACK_RATIO;
+    }
+
+    return 0;
+}
+
+void callbench_set_progress(callbench_progress_fn fn, void *ctx) {
+    progress_fn = fn;
+    progress_ctx = ctx;
+}
@@ -0,0 +1,91 @@
+/*
+ * libcallbench.h
+ *
+ * Embeddable interface to the callbench benchmarks, for running probes such as
+ * vDSO or syscall entry costs from inside another program. Nothing here writes
+ * to stdout; progress is only reported through the optional callback.
+ *
+ * Calls are not thread-safe: run one benchmark at a time, from any thread.
+ *
+ * Licensed under the MIT License (MIT)
+ *
+ * Copyright (c) 2018-2020 Danny Lin <danny@kdrag0n.dev>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LIBCALLBENCH_H
+#define LIBCALLBENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called after every timed round, e.g. to keep a watchdog happy during long runs
+typedef void (*callbench_progress_fn)(void *ctx);
+
+struct callbench_config {
+    double budget_s; // time to spend measuring, or 0 for 1 second
+    double target_error; // stop early once the median's 95% CI is within this fraction, or 0 for 1%
+    long size; // bytes per call for sized benchmarks, or 0 for 64 KiB
+    int batch; // operations per call for batched benchmarks, or 0 for 1
+};
+
+struct callbench_stats {
+    double ns; // per call, with loop and timer overhead subtracted
+    double raw_ns;
+    double overhead_ns;
+    double calls_per_sec;
+    double min_ns;
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+    double max_ns;
+    double mean_ns;
+    double stddev_ns;
+    double median_ns;
+    double ci_low_ns; // 95% confidence interval on the median
+    double ci_high_ns;
+    long samples; // timed loops
+    long outliers;
+    int rounds;
+    int converged; // whether target_error was reached within budget_s
+    int vdso_fallback; // 1 if a vDSO call is no faster than its syscall, 0 if it is, -1 if n/a
+};
+
+// Calibrates the timer; returns 0 or a negative errno. callbench_run calls it if
+// needed, but calling it first keeps the calibration out of the first run.
+int callbench_init(void);
+
+// Lists benchmarks by index, for names to pass to callbench_run; returns -ENOENT past the end
+int callbench_count(void);
+int callbench_info(int index, const char **group, const char **name, const char **desc);
+
+// Runs a benchmark named "group.name", e.g. "time.libc"; returns 0, -ENOENT if
+// there is no such benchmark, -ENOTSUP if it can't run on this host, or -ENOMEM
+// or -EAGAIN if it ran out of memory or threads
+int callbench_run(const char *name, const struct callbench_config *config, struct callbench_stats *stats);
+
+void callbench_set_progress(callbench_progress_fn fn, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif